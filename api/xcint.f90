@@ -7,9 +7,14 @@ module xcint
    public xcint_new_context
    public xcint_free_context
    public xcint_set_functional
+   public xcint_set_precision
+   public xcint_set_matrix_storage
+   public xcint_set_spherical_transform
    public xcint_set_basis
    public xcint_integrate_scf
    public xcint_integrate
+   public xcint_integrate_gradient
+   public xcint_integrate_hessian
 
    public XCINT_MODE_RKS
    public XCINT_MODE_UKS
@@ -19,6 +24,13 @@ module xcint
    public XCINT_PERT_GEO
    public XCINT_PERT_MAG_CGO
    public XCINT_PERT_MAG_LAO
+   public XCINT_PRECISION_DOUBLE
+   public XCINT_PRECISION_MIXED
+   public XCINT_STORAGE_DENSE
+   public XCINT_STORAGE_BLOCK_SPARSE
+   public XCINT_STORAGE_PACKED
+   public XCINT_TRANSFORM_AO
+   public XCINT_TRANSFORM_DMAT
 
    private
 
@@ -39,6 +51,22 @@ module xcint
       enumerator :: XCINT_PERT_MAG_LAO
    end enum
 
+   enum, bind(c)
+      enumerator :: XCINT_PRECISION_DOUBLE
+      enumerator :: XCINT_PRECISION_MIXED
+   end enum
+
+   enum, bind(c)
+      enumerator :: XCINT_STORAGE_DENSE
+      enumerator :: XCINT_STORAGE_BLOCK_SPARSE
+      enumerator :: XCINT_STORAGE_PACKED
+   end enum
+
+   enum, bind(c)
+      enumerator :: XCINT_TRANSFORM_AO
+      enumerator :: XCINT_TRANSFORM_DMAT
+   end enum
+
    interface xcint_new_context
       function xcint_new_context() result(context) bind (C)
          import :: c_ptr
@@ -63,6 +91,40 @@ module xcint
       end function
    end interface
 
+   interface xcint_set_precision
+      function xcint_set_precision(context,                 &
+                                   precision) result(ierr) bind (C)
+         import :: c_ptr, c_int
+         type(c_ptr), value                :: context
+         integer(c_int), intent(in), value :: precision
+         integer(c_int) :: ierr
+      end function
+   end interface
+
+   interface xcint_set_matrix_storage
+      function xcint_set_matrix_storage(context,            &
+                                        storage,            &
+                                        num_blocks,         &
+                                        block_centers) result(ierr) bind (C)
+         import :: c_ptr, c_int
+         type(c_ptr), value                :: context
+         integer(c_int), intent(in), value :: storage
+         integer(c_int), intent(in), value :: num_blocks
+         integer(c_int), intent(in)        :: block_centers(*)
+         integer(c_int) :: ierr
+      end function
+   end interface
+
+   interface xcint_set_spherical_transform
+      function xcint_set_spherical_transform(context,         &
+                                             transform) result(ierr) bind (C)
+         import :: c_ptr, c_int
+         type(c_ptr), value                :: context
+         integer(c_int), intent(in), value :: transform
+         integer(c_int) :: ierr
+      end function
+   end interface
+
    interface xcint_set_basis
       function xcint_set_basis(context,                 &
                                basis_type,              &
@@ -159,4 +221,54 @@ module xcint
       end function
    end interface
 
+   interface xcint_integrate_gradient
+      function xcint_integrate_gradient(context,     &
+                                        mode,        &
+                                        num_points,  &
+                                        grid_x_bohr, &
+                                        grid_y_bohr, &
+                                        grid_z_bohr, &
+                                        grid_w,      &
+                                        dmat,        &
+                                        gradient) result(ierr) bind (C)
+         import :: c_ptr, c_int, c_double
+         type(c_ptr), value                :: context
+         integer(c_int), intent(in), value :: mode
+         integer(c_int), intent(in), value :: num_points
+         real(c_double), intent(in)        :: grid_x_bohr(*)
+         real(c_double), intent(in)        :: grid_y_bohr(*)
+         real(c_double), intent(in)        :: grid_z_bohr(*)
+         real(c_double), intent(in)        :: grid_w(*)
+         real(c_double), intent(in)        :: dmat(*)
+         real(c_double), intent(inout)     :: gradient(*)
+         integer(c_int) :: ierr
+      end function
+   end interface
+
+   interface xcint_integrate_hessian
+      function xcint_integrate_hessian(context,     &
+                                       mode,        &
+                                       num_points,  &
+                                       grid_x_bohr, &
+                                       grid_y_bohr, &
+                                       grid_z_bohr, &
+                                       grid_w,      &
+                                       num_dmat,    &
+                                       dmat,        &
+                                       hessian) result(ierr) bind (C)
+         import :: c_ptr, c_int, c_double
+         type(c_ptr), value                :: context
+         integer(c_int), intent(in), value :: mode
+         integer(c_int), intent(in), value :: num_points
+         real(c_double), intent(in)        :: grid_x_bohr(*)
+         real(c_double), intent(in)        :: grid_y_bohr(*)
+         real(c_double), intent(in)        :: grid_z_bohr(*)
+         real(c_double), intent(in)        :: grid_w(*)
+         integer(c_int), intent(in), value :: num_dmat
+         real(c_double), intent(in)        :: dmat(*)
+         real(c_double), intent(inout)     :: hessian(*)
+         integer(c_int) :: ierr
+      end function
+   end interface
+
 end module
@@ -40,6 +40,22 @@ typedef enum {
     XCINT_PERT_MAG_LAO
     } xcint_perturbation_t;
 
+typedef enum {
+    XCINT_PRECISION_DOUBLE,
+    XCINT_PRECISION_MIXED
+    } xcint_precision_t;
+
+typedef enum {
+    XCINT_STORAGE_DENSE,
+    XCINT_STORAGE_BLOCK_SPARSE,
+    XCINT_STORAGE_PACKED
+    } xcint_storage_t;
+
+typedef enum {
+    XCINT_TRANSFORM_AO,
+    XCINT_TRANSFORM_DMAT
+    } xcint_transform_t;
+
 struct xcint_context_s;
 typedef struct xcint_context_s xcint_context_t;
 
@@ -55,6 +71,28 @@ int xcint_set_functional(
           char *line
     );
 
+/* precision policy for all following integrate calls:
+   XCINT_PRECISION_DOUBLE (default) does everything in double precision,
+   XCINT_PRECISION_MIXED does the AO matrix multiplications in single
+   precision with double-precision accumulation of n, u, and vxc
+   (see doc/interfacing.rst for error bounds) */
+XCINT_API
+int xcint_set_precision(
+    xcint_context_t *context,
+    const xcint_precision_t precision
+    );
+
+/* where the spherical basis is handled, has to be called before
+   xcint_set_basis: XCINT_TRANSFORM_AO (default) transforms the AOs to
+   spherical ones at every grid point, XCINT_TRANSFORM_DMAT evaluates
+   Cartesian AOs and instead transforms dmat to the Cartesian basis and
+   vxc back once per integrate call (see doc/interfacing.rst) */
+XCINT_API
+int xcint_set_spherical_transform(
+    xcint_context_t *context,
+    const xcint_transform_t transform
+    );
+
 XCINT_API
 int xcint_set_basis(
     xcint_context_t *context,
@@ -69,6 +107,21 @@ int xcint_set_basis(
     const double contraction_coefficients[]
     );
 
+/* storage of dmat and vxc for all following integrate calls, has to be
+   called after xcint_set_basis which resets it to XCINT_STORAGE_DENSE;
+   for XCINT_STORAGE_BLOCK_SPARSE block_centers holds num_blocks pairs
+   of centers (counting from 1), each block is stored row-major one after
+   the other in this order and the pattern has to be symmetric;
+   XCINT_STORAGE_PACKED stores the lower triangle row by row
+   (see doc/interfacing.rst) */
+XCINT_API
+int xcint_set_matrix_storage(
+    xcint_context_t *context,
+    const xcint_storage_t storage,
+    const int    num_blocks,
+    const int    block_centers[]
+    );
+
 /* convenience shortcut function for SCF contributions */
 XCINT_API
 int xcint_integrate_scf(
@@ -85,7 +138,10 @@ int xcint_integrate_scf(
           double vxc[],
           double *num_electrons);
 
-/* general swiss army knife function */
+/* general swiss army knife function; a matrix in dmat whose element
+   pairs agree to within 1e-12 times its largest element is treated as
+   exactly symmetric, one whose pairs cancel to within that tolerance as
+   exactly antisymmetric and then contributes no density */
 XCINT_API
 int xcint_integrate(
 //  const xcint_context_t *context,
@@ -108,6 +164,47 @@ int xcint_integrate(
           double vxc[],
           double *num_electrons);
 
+/* derivatives of the XC energy with respect to all nuclear coordinates
+   from one grid pass, equivalent to 3 * num_centers xcint_integrate calls
+   with one XCINT_PERT_GEO each; gradient holds x, y, z for every center;
+   the components of the center with the most AOs are obtained from the
+   others by translational invariance, so for this center they differ
+   from xcint_integrate by the integration error of the grid */
+XCINT_API
+int xcint_integrate_gradient(
+//  const xcint_context_t *context,
+          xcint_context_t *context,
+    const xcint_mode_t mode,
+    const int    num_points,
+    const double grid_x_bohr[],
+    const double grid_y_bohr[],
+    const double grid_z_bohr[],
+    const double grid_w[],
+    const double dmat[],
+          double gradient[]);
+
+/* second derivatives of the XC energy with respect to all nuclear
+   coordinates from one grid pass, hessian is a row-major matrix of
+   dimension 3 * num_centers; with num_dmat = 1 only the part at fixed
+   dmat is computed, with num_dmat = 1 + 3 * num_centers the matrices
+   after the first are the derivatives of dmat with respect to each
+   coordinate (e.g. from CPKS) and the response of the gradient of
+   xcint_integrate_gradient to them is added; rows and columns of the
+   center left out there follow by translational invariance */
+XCINT_API
+int xcint_integrate_hessian(
+//  const xcint_context_t *context,
+          xcint_context_t *context,
+    const xcint_mode_t mode,
+    const int    num_points,
+    const double grid_x_bohr[],
+    const double grid_y_bohr[],
+    const double grid_z_bohr[],
+    const double grid_w[],
+    const int    num_dmat,
+    const double dmat[],
+          double hessian[]);
+
 #ifdef __cplusplus
 }
 #endif
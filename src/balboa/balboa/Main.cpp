@@ -3,22 +3,34 @@
 #include <iostream>
 #include <math.h>
 #include <stdio.h>
+#include <vector>
 
 #include "Main.h"
-#include "ao_dispatch.h"
-#include "autogenerated.h"
+#include "Workspace.h"
+#include "ao_kernels.h"
+#include "ao_vector.h"
 #include "balboa.h"
-#include "offsets.h"
+#include "cs_trans.h"
 #include "balboa_parameters.h"
 
 #define AS_TYPE(Type, Obj) reinterpret_cast<Type *>(Obj)
 #define AS_CTYPE(Type, Obj) reinterpret_cast<const Type *>(Obj)
 
+// highest geometric derivative order for which the radial functions
+// are tabulated, higher orders always sum the primitives
+const int SPLINE_MAX_GEO_ORDER = 2;
+
 balboa_context_t *balboa_new_context()
 {
     return AS_TYPE(balboa_context_t, new Main());
 }
-Main::Main() { nullify(); }
+Main::Main()
+{
+    // not part of nullify since they survive set_basis
+    spline_accuracy = 0.0;
+    ao_isa = get_ao_isa();
+    nullify();
+}
 
 void balboa_free_context(balboa_context_t *balboa_context)
 {
@@ -58,7 +70,46 @@ int Main::get_buffer_len(const int max_geo_order, const int num_points) const
             }
         }
     }
-    return m * num_points * num_ao_cartesian;
+    return m * num_points * num_ao;
+}
+
+int balboa_get_aligned_leading_dim(const balboa_context_t *balboa_context,
+                                   const balboa_ao_order_t order,
+                                   const int num_points)
+{
+    return AS_CTYPE(Main, balboa_context)
+        ->get_aligned_leading_dim(order == BALBOA_POINT_MAJOR, num_points);
+}
+int Main::get_aligned_leading_dim(const bool is_point_major,
+                                  const int num_points) const
+{
+    if (is_point_major)
+        return get_padded_length(num_ao);
+    return get_padded_length(num_points);
+}
+
+int balboa_get_layout_buffer_len(const balboa_context_t *balboa_context,
+                                 const balboa_ao_order_t order,
+                                 const int leading_dim,
+                                 const int max_geo_order,
+                                 const int num_points)
+{
+    return AS_CTYPE(Main, balboa_context)
+        ->get_layout_buffer_len(order == BALBOA_POINT_MAJOR,
+                                leading_dim,
+                                max_geo_order,
+                                num_points);
+}
+int Main::get_layout_buffer_len(const bool is_point_major,
+                                const int leading_dim,
+                                const int max_geo_order,
+                                const int num_points) const
+{
+    int num_slices = (max_geo_order + 1) * (max_geo_order + 2) *
+                     (max_geo_order + 3) / 6;
+    // one row of leading_dim elements per AO or point
+    int num_rows = is_point_major ? num_points : num_ao;
+    return num_slices * num_rows * leading_dim;
 }
 
 int balboa_get_ao_center(const balboa_context_t *balboa_context, const int i)
@@ -67,6 +118,33 @@ int balboa_get_ao_center(const balboa_context_t *balboa_context, const int i)
 }
 int Main::get_ao_center(const int i) const { return ao_center[i]; }
 
+int balboa_get_num_shells(const balboa_context_t *balboa_context)
+{
+    return AS_CTYPE(Main, balboa_context)->get_num_shells();
+}
+int Main::get_num_shells() const { return num_shells; }
+
+int balboa_get_shell_off(const balboa_context_t *balboa_context, const int i)
+{
+    return AS_CTYPE(Main, balboa_context)->get_shell_off(i);
+}
+int Main::get_shell_off(const int i) const { return shell_off[i]; }
+
+int balboa_get_spherical_transform(const balboa_context_t *balboa_context,
+                                   const int i,
+                                   double coefficients[])
+{
+    return AS_CTYPE(Main, balboa_context)
+        ->get_spherical_transform(i, coefficients);
+}
+int Main::get_spherical_transform(const int i, double coefficients[]) const
+{
+    const double *t = get_cs_trans(shell_l_quantum_numbers[i]);
+    int len = cartesian_deg[i] * spherical_deg[i];
+    std::copy(&t[0], &t[len], &coefficients[0]);
+    return 0;
+}
+
 int balboa_get_geo_offset(const balboa_context_t *balboa_context,
                           const int i,
                           const int j,
@@ -130,9 +208,10 @@ int Main::set_basis(const int in_basis_type,
         is_spherical = true;
         break;
     case 1:
+        // the Cartesian components share the contraction coefficients
+        // of their shell, these are the functions which the spherical
+        // transformation combines
         is_spherical = false;
-        fprintf(stderr, "ERROR: XCINT_BASIS_CARTESIAN not tested.\n");
-        exit(-1);
         break;
     default:
         fprintf(stderr, "ERROR: basis_type not recognized.\n");
@@ -151,18 +230,6 @@ int Main::set_basis(const int in_basis_type,
     std::copy(
         &in_shell_centers[0], &in_shell_centers[num_shells], &shell_centers[0]);
 
-    shell_centers_coordinates = new double[3 * num_shells];
-
-    for (int ishell = 0; ishell < num_shells; ishell++)
-    {
-        for (int ixyz = 0; ixyz < 3; ixyz++)
-        {
-            shell_centers_coordinates[3 * ishell + ixyz] =
-                in_center_coordinates_bohr[3 * (in_shell_centers[ishell] - 1) +
-                                           ixyz];
-        }
-    }
-
     shell_l_quantum_numbers = new int[num_shells];
     std::copy(&in_shell_l_quantum_numbers[0],
               &in_shell_l_quantum_numbers[num_shells],
@@ -197,36 +264,115 @@ int Main::set_basis(const int in_basis_type,
               &in_contraction_coefficients[n],
               &contraction_coefficients[0]);
 
-    // get approximate spacial shell extent
+    // get approximate spacial primitive and shell extent
     double SHELL_SCREENING_THRESHOLD = 2.0e-12;
+    // tighter for single points and primitives which are dropped
+    // individually inside chunks that pass the shell screening
+    double POINT_SCREENING_THRESHOLD = 1.0e-15;
     double e, c, r, r_temp;
     // threshold and factors match Dalton implementation, see also pink book
     double f[10] = {1.0, 1.3333, 1.6, 1.83, 2.03, 2.22, 2.39, 2.55, 2.70, 2.84};
+    primitive_extent_squared = new double[n];
     shell_extent_squared = new double[num_shells];
     n = 0;
     for (int ishell = 0; ishell < num_shells; ishell++)
     {
+        double f2 = 1.0e20;
+        if (shell_l_quantum_numbers[ishell] < 10)
+            f2 = f[shell_l_quantum_numbers[ishell]] *
+                 f[shell_l_quantum_numbers[ishell]];
         r = 0.0;
         for (int j = 0; j < shell_num_primitives[ishell]; j++)
         {
-            e = primitive_exponents[n];
-            c = contraction_coefficients[n];
-            n++;
+            e = primitive_exponents[n + j];
+            c = contraction_coefficients[n + j];
             r_temp = (log(fabs(c)) - log(SHELL_SCREENING_THRESHOLD)) / e;
+            primitive_extent_squared[n + j] =
+                std::max(log(fabs(c)) - log(POINT_SCREENING_THRESHOLD), 0.0) /
+                e * f2;
             if (r_temp > r)
                 r = r_temp;
         }
-        if (shell_l_quantum_numbers[ishell] < 10)
+        shell_extent_squared[ishell] = r * f2;
+
+        // sort primitives by decreasing extent (roughly increasing
+        // exponent) so that for a given distance the negligible
+        // primitives are at the end and can be cut off
+        int num_primitives = shell_num_primitives[ishell];
+        std::vector<int> order(num_primitives);
+        for (int j = 0; j < num_primitives; j++)
+            order[j] = j;
+        std::stable_sort(order.begin(), order.end(), [&](int u, int v) {
+            return primitive_extent_squared[n + u] >
+                   primitive_extent_squared[n + v];
+        });
+        std::vector<double> t_exp(num_primitives);
+        std::vector<double> t_coef(num_primitives);
+        std::vector<double> t_ext(num_primitives);
+        for (int j = 0; j < num_primitives; j++)
         {
-            r = pow(r, 0.5) * f[shell_l_quantum_numbers[ishell]];
+            t_exp[j] = primitive_exponents[n + order[j]];
+            t_coef[j] = contraction_coefficients[n + order[j]];
+            t_ext[j] = primitive_extent_squared[n + order[j]];
         }
-        else
+        std::copy(t_exp.begin(), t_exp.end(), &primitive_exponents[n]);
+        std::copy(t_coef.begin(), t_coef.end(), &contraction_coefficients[n]);
+        std::copy(t_ext.begin(), t_ext.end(), &primitive_extent_squared[n]);
+
+        n += num_primitives;
+    }
+
+    // shells grouped by center, in their original order
+    center_shell_off = new int[num_centers + 1];
+    center_shells = new int[num_shells];
+    shell_primitive_off = new int[num_shells];
+    std::fill(&center_shell_off[0], &center_shell_off[num_centers + 1], 0);
+    n = 0;
+    for (int ishell = 0; ishell < num_shells; ishell++)
+    {
+        center_shell_off[shell_centers[ishell]]++;
+        shell_primitive_off[ishell] = n;
+        n += shell_num_primitives[ishell];
+    }
+    for (int icenter = 0; icenter < num_centers; icenter++)
+    {
+        center_shell_off[icenter + 1] += center_shell_off[icenter];
+    }
+    std::vector<int> next(&center_shell_off[0], &center_shell_off[num_centers]);
+    for (int ishell = 0; ishell < num_shells; ishell++)
+    {
+        int icenter = shell_centers[ishell] - 1;
+        center_shells[next[icenter]] = ishell;
+        next[icenter]++;
+    }
+
+    // shells on one center which share exponents (general contractions)
+    // share the primitive exponentials, each primitive points to its
+    // exponent among the distinct ones of its center
+    primitive_exp_index = new int[n];
+    max_center_num_exp = 0;
+    for (int icenter = 0; icenter < num_centers; icenter++)
+    {
+        std::vector<double> exps;
+        for (int i = center_shell_off[icenter];
+             i < center_shell_off[icenter + 1];
+             i++)
         {
-            r = 1.0e10;
+            int ishell = center_shells[i];
+            int off = shell_primitive_off[ishell];
+            for (int j = 0; j < shell_num_primitives[ishell]; j++)
+            {
+                double e = primitive_exponents[off + j];
+                int u = std::find(exps.begin(), exps.end(), e) - exps.begin();
+                if (u == (int)exps.size())
+                    exps.push_back(e);
+                primitive_exp_index[off + j] = u;
+            }
         }
-        shell_extent_squared[ishell] = r * r;
+        max_center_num_exp = std::max(max_center_num_exp, (int)exps.size());
     }
 
+    max_shell_deg = 0;
     cartesian_deg = new int[num_shells];
     shell_off = new int[num_shells];
     spherical_deg = new int[num_shells];
@@ -240,6 +386,9 @@ int Main::set_basis(const int in_basis_type,
         ks = 2 * l + 1;
         cartesian_deg[ishell] = kc;
         spherical_deg[ishell] = ks;
+        // AOs written per shell; the Cartesian components of spherical
+        // shells only live in the kernel buffer of the workspace
+        max_shell_deg = std::max(max_shell_deg, is_spherical ? ks : kc);
 
         if (is_spherical)
         {
@@ -260,10 +409,6 @@ int Main::set_basis(const int in_basis_type,
     }
     else
     {
-        fprintf(
-            stderr,
-            "ERROR: XCint probably broken for cart basis, needs testing.\n");
-        exit(-1);
         num_ao = num_ao_cartesian;
     }
 
@@ -315,10 +460,323 @@ int Main::set_basis(const int in_basis_type,
 
     is_initialized = 12345678;
 
+    if (spline_accuracy > 0.0)
+        tabulate_splines();
+
     return 0;
 }
 
+int balboa_set_spline_accuracy(balboa_context_t *balboa_context,
+                               const double accuracy)
+{
+    return AS_TYPE(Main, balboa_context)->set_spline_accuracy(accuracy);
+}
+int Main::set_spline_accuracy(const double accuracy)
+{
+    if (accuracy < 0.0)
+    {
+        fprintf(stderr, "ERROR: spline accuracy must not be negative.\n");
+        return -1;
+    }
+
+    spline_accuracy = accuracy;
+
+    if (is_initialized == 12345678)
+    {
+        if (spline_accuracy > 0.0)
+        {
+            tabulate_splines();
+        }
+        else
+        {
+            delete[] spline_table;
+            spline_table = NULL;
+        }
+    }
+
+    return 0;
+}
+
+// g[m] = sum_i c_i (-a_i)^m exp(-a_i u), the m-th derivative with respect
+// to u = r^2 of the contracted radial function
+static void get_radial_derivatives(const int num_primitives,
+                                   const double primitive_exponents[],
+                                   const double contraction_coefficients[],
+                                   const double u,
+                                   const int num_derivatives,
+                                   double g[])
+{
+    std::fill(&g[0], &g[num_derivatives], 0.0);
+    for (int i = 0; i < num_primitives; i++)
+    {
+        double a = -primitive_exponents[i];
+        double f = contraction_coefficients[i] * exp(a * u);
+        for (int m = 0; m < num_derivatives; m++)
+        {
+            g[m] += f;
+            f *= a;
+        }
+    }
+}
+
+// the radial functions and their derivatives with respect to r^2 are
+// tabulated per center on the mesh r = x^2 with uniform steps in x; this
+// is dense close to the nucleus where the tight primitives matter and
+// coarse in the tail, and the mesh position of a point only costs two
+// square roots of its squared distance; the values and slopes at the nodes are
+// exact, between nodes cubic Hermite interpolation is used, and the step
+// is halved until all midpoints are within the requested accuracy
+// relative to the largest value of each function; shells that still miss
+// it after the last halving get spline_shell_off -1 and sum the primitives
+void Main::tabulate_splines()
+{
+    const int num_orders = SPLINE_MAX_GEO_ORDER + 1;
+
+    delete[] spline_step;
+    delete[] spline_r_max;
+    delete[] spline_num_nodes;
+    delete[] spline_shell_off;
+    delete[] spline_table;
+
+    spline_step = new double[num_centers];
+    spline_r_max = new double[num_centers];
+    spline_num_nodes = new int[num_centers];
+    spline_shell_off = new int[num_shells];
+
+    std::vector<double> table;
+    double g[num_orders + 1];
+
+    for (int icenter = 0; icenter < num_centers; icenter++)
+    {
+        double a_max = 0.0;
+        double r2_max = 0.0;
+        for (int i = center_shell_off[icenter];
+             i < center_shell_off[icenter + 1];
+             i++)
+        {
+            int ishell = center_shells[i];
+            int n = shell_primitive_off[ishell];
+            for (int j = 0; j < shell_num_primitives[ishell]; j++)
+            {
+                a_max = std::max(a_max, primitive_exponents[n + j]);
+                r2_max = std::max(r2_max, primitive_extent_squared[n + j]);
+            }
+        }
+        spline_num_nodes[icenter] = 0;
+        if (a_max == 0.0)
+            continue;
+
+        double r_max = sqrt(r2_max);
+        double step = 0.25 / sqrt(sqrt(a_max));
+        int num_nodes = 0;
+        std::vector<double> center_table;
+        std::vector<bool> shell_is_accurate(center_shell_off[icenter + 1] -
+                                            center_shell_off[icenter]);
+
+        for (int attempt = 0; attempt < 10; attempt++)
+        {
+            // the step has to match the table that is kept
+            if (attempt > 0)
+                step *= 0.5;
+            num_nodes = (int)(sqrt(r_max) / step) + 2;
+            center_table.assign((center_shell_off[icenter + 1] -
+                                 center_shell_off[icenter]) *
+                                    num_orders * num_nodes * 2,
+                                0.0);
+
+            bool is_accurate = true;
+            for (int i = center_shell_off[icenter];
+                 i < center_shell_off[icenter + 1];
+                 i++)
+            {
+                int ishell = center_shells[i];
+                int n = shell_primitive_off[ishell];
+                double *t = &center_table[(i - center_shell_off[icenter]) *
+                                          num_orders * num_nodes * 2];
+
+                for (int k = 0; k < num_nodes; k++)
+                {
+                    double x = k * step;
+                    get_radial_derivatives(shell_num_primitives[ishell],
+                                           &primitive_exponents[n],
+                                           &contraction_coefficients[n],
+                                           x * x * x * x,
+                                           num_orders + 1,
+                                           g);
+                    for (int m = 0; m < num_orders; m++)
+                    {
+                        t[(m * num_nodes + k) * 2] = g[m];
+                        t[(m * num_nodes + k) * 2 + 1] =
+                            4.0 * x * x * x * g[m + 1];
+                    }
+                }
+
+                double error[num_orders];
+                double largest[num_orders];
+                std::fill(&error[0], &error[num_orders], 0.0);
+                std::fill(&largest[0], &largest[num_orders], 0.0);
+                for (int k = 0; k + 1 < num_nodes; k++)
+                {
+                    double x = (k + 0.5) * step;
+                    get_radial_derivatives(shell_num_primitives[ishell],
+                                           &primitive_exponents[n],
+                                           &contraction_coefficients[n],
+                                           x * x * x * x,
+                                           num_orders,
+                                           g);
+                    for (int m = 0; m < num_orders; m++)
+                    {
+                        const double *y = &t[(m * num_nodes + k) * 2];
+                        double v = 0.5 * (y[0] + y[2]) +
+                                   0.125 * step * (y[1] - y[3]);
+                        error[m] = std::max(error[m], fabs(v - g[m]));
+                        largest[m] = std::max(largest[m], fabs(y[0]));
+                    }
+                }
+                shell_is_accurate[i - center_shell_off[icenter]] = true;
+                for (int m = 0; m < num_orders; m++)
+                {
+                    if (error[m] > spline_accuracy * largest[m])
+                    {
+                        shell_is_accurate[i - center_shell_off[icenter]] =
+                            false;
+                        is_accurate = false;
+                    }
+                }
+            }
+
+            if (is_accurate)
+                break;
+        }
+
+        spline_step[icenter] = step;
+        spline_r_max[icenter] = r_max;
+        spline_num_nodes[icenter] = num_nodes;
+        for (int i = center_shell_off[icenter];
+             i < center_shell_off[icenter + 1];
+             i++)
+        {
+            spline_shell_off[center_shells[i]] = -1;
+            if (shell_is_accurate[i - center_shell_off[icenter]])
+                spline_shell_off[center_shells[i]] =
+                    table.size() + (i - center_shell_off[icenter]) *
+                                       num_orders * num_nodes * 2;
+        }
+        table.insert(table.end(), center_table.begin(), center_table.end());
+    }
+
+    spline_table = new double[table.size()];
+    std::copy(table.begin(), table.end(), &spline_table[0]);
+}
+
+// radial parts of a shell, the slices geo_ijk of x^0 y^0 z^0 in the kernel
+// buffer, from the tabulated derivatives g_m of the radial function with
+// respect to u = r^2, using d/dx = 2 x d/du
+void Main::get_spline_radial(const int ishell,
+                             const int max_geo_order,
+                             const int num_points_batch,
+                             const int spline_node[],
+                             const double spline_weight[],
+                             const double px[],
+                             const double py[],
+                             const double pz[],
+                             double g[],
+                             double radial[]) const
+{
+    int icenter = shell_centers[ishell] - 1;
+    int num_nodes = spline_num_nodes[icenter];
+
+    for (int m = 0; m <= max_geo_order; m++)
+    {
+        const double *t =
+            &spline_table[spline_shell_off[ishell] + m * num_nodes * 2];
+        double *gm = &g[m * AO_CHUNK_LENGTH];
+        for (int k = 0; k < num_points_batch; k++)
+        {
+            int node = spline_node[k];
+            if (node < 0)
+            {
+                gm[k] = 0.0;
+                continue;
+            }
+            const double *y = &t[node * 2];
+            const double *w = &spline_weight[4 * k];
+            gm[k] = w[0] * y[0] + w[1] * y[1] + w[2] * y[2] + w[3] * y[3];
+        }
+    }
+
+    const int CH = AO_CHUNK_LENGTH;
+    const double *g0 = &g[0];
+    const double *g1 = &g[CH];
+    const double *g2 = &g[2 * CH];
+
+    std::copy(&g0[0], &g0[num_points_batch], &radial[0]);
+    if (max_geo_order < 1)
+        return;
+    for (int k = 0; k < num_points_batch; k++)
+    {
+        radial[CH + k] = 2.0 * px[k] * g1[k];
+        radial[2 * CH + k] = 2.0 * py[k] * g1[k];
+        radial[3 * CH + k] = 2.0 * pz[k] * g1[k];
+    }
+    if (max_geo_order < 2)
+        return;
+    for (int k = 0; k < num_points_batch; k++)
+    {
+        double x = 2.0 * px[k];
+        double y = 2.0 * py[k];
+        double z = 2.0 * pz[k];
+        radial[4 * CH + k] = x * x * g2[k] + 2.0 * g1[k];
+        radial[5 * CH + k] = x * y * g2[k];
+        radial[6 * CH + k] = x * z * g2[k];
+        radial[7 * CH + k] = y * y * g2[k] + 2.0 * g1[k];
+        radial[8 * CH + k] = y * z * g2[k];
+        radial[9 * CH + k] = z * z * g2[k] + 2.0 * g1[k];
+    }
+}
+
+balboa_workspace_t *balboa_new_workspace(
+    const balboa_context_t *balboa_context, const int max_geo_order)
+{
+    return AS_TYPE(balboa_workspace_t,
+                   AS_CTYPE(Main, balboa_context)
+                       ->new_workspace(max_geo_order));
+}
+Workspace *Main::new_workspace(const int max_geo_order) const
+{
+    int max_l_quantum_number;
+    int max_num_primitives;
+    get_workspace_size(max_l_quantum_number, max_num_primitives);
+    return new Workspace(max_geo_order,
+                         max_l_quantum_number,
+                         max_shell_deg,
+                         max_center_num_exp,
+                         max_num_primitives);
+}
+
+void balboa_free_workspace(balboa_workspace_t *workspace)
+{
+    if (!workspace)
+        return;
+    delete AS_TYPE(Workspace, workspace);
+}
+
+void Main::get_workspace_size(int &max_l_quantum_number,
+                              int &max_num_primitives) const
+{
+    max_l_quantum_number = 0;
+    max_num_primitives = 0;
+    for (int ishell = 0; ishell < num_shells; ishell++)
+    {
+        max_l_quantum_number =
+            std::max(max_l_quantum_number, shell_l_quantum_numbers[ishell]);
+        max_num_primitives =
+            std::max(max_num_primitives, shell_num_primitives[ishell]);
+    }
+}
+
 int balboa_get_ao(const balboa_context_t *balboa_context,
+                  balboa_workspace_t *workspace,
                   const int max_geo_order,
                   const int num_points,
                   const double x_coordinates_bohr[],
@@ -327,71 +785,455 @@ int balboa_get_ao(const balboa_context_t *balboa_context,
                   double buffer[])
 {
     return AS_CTYPE(Main, balboa_context)
-        ->get_ao(max_geo_order,
+        ->get_ao(AS_TYPE(Workspace, workspace),
+                 false,
+                 num_points,
+                 max_geo_order,
+                 max_geo_order,
+                 0,
+                 NULL,
+                 num_points,
+                 x_coordinates_bohr,
+                 y_coordinates_bohr,
+                 z_coordinates_bohr,
+                 buffer);
+}
+
+int balboa_get_ao_layout(const balboa_context_t *balboa_context,
+                         balboa_workspace_t *workspace,
+                         const balboa_ao_order_t order,
+                         const int leading_dim,
+                         const int max_geo_order,
+                         const int num_points,
+                         const double x_coordinates_bohr[],
+                         const double y_coordinates_bohr[],
+                         const double z_coordinates_bohr[],
+                         double buffer[])
+{
+    return AS_CTYPE(Main, balboa_context)
+        ->get_ao(AS_TYPE(Workspace, workspace),
+                 order == BALBOA_POINT_MAJOR,
+                 leading_dim,
+                 max_geo_order,
+                 max_geo_order,
+                 0,
+                 NULL,
+                 num_points,
+                 x_coordinates_bohr,
+                 y_coordinates_bohr,
+                 z_coordinates_bohr,
+                 buffer);
+}
+int balboa_get_ao_on_centers(const balboa_context_t *balboa_context,
+                             balboa_workspace_t *workspace,
+                             const int max_geo_order,
+                             const int base_geo_order,
+                             const int num_derv_centers,
+                             const int derv_centers[],
+                             const int num_points,
+                             const double x_coordinates_bohr[],
+                             const double y_coordinates_bohr[],
+                             const double z_coordinates_bohr[],
+                             double buffer[])
+{
+    return AS_CTYPE(Main, balboa_context)
+        ->get_ao(AS_TYPE(Workspace, workspace),
+                 false,
+                 num_points,
+                 max_geo_order,
+                 base_geo_order,
+                 num_derv_centers,
+                 derv_centers,
                  num_points,
                  x_coordinates_bohr,
                  y_coordinates_bohr,
                  z_coordinates_bohr,
                  buffer);
 }
-int Main::get_ao(const int max_geo_order,
+int Main::get_ao(Workspace *workspace,
+                 const bool is_point_major,
+                 const int leading_dim,
+                 const int max_geo_order,
+                 const int base_geo_order,
+                 const int num_derv_centers,
+                 const int derv_centers[],
                  const int num_points,
                  const double x_coordinates_bohr[],
                  const double y_coordinates_bohr[],
                  const double z_coordinates_bohr[],
                  double ao_local[]) const
 {
-    double px[AO_CHUNK_LENGTH];
-    double py[AO_CHUNK_LENGTH];
-    double pz[AO_CHUNK_LENGTH];
-    double p2[AO_CHUNK_LENGTH];
-    double s[AO_CHUNK_LENGTH];
-    double buffer[BUFFER_LENGTH];
+    assert(max_geo_order <= MAX_GEO_DIFF_ORDER);
+
+    if (leading_dim < (is_point_major ? num_ao : num_points))
+    {
+        fprintf(stderr, "ERROR: balboa leading dimension too small.\n");
+        return -1;
+    }
+
+    if (base_geo_order < 0 or base_geo_order > max_geo_order)
+    {
+        fprintf(stderr,
+                "ERROR: base_geo_order must be within 0 and "
+                "max_geo_order.\n");
+        return -1;
+    }
+
+    int max_l_quantum_number;
+    int max_num_primitives;
+    get_workspace_size(max_l_quantum_number, max_num_primitives);
+
+    Workspace *temporary = NULL;
+    if (workspace == NULL)
+    {
+        temporary = new_workspace(max_geo_order);
+        workspace = temporary;
+    }
+    if (not workspace->fits(max_geo_order,
+                            max_l_quantum_number,
+                            max_shell_deg,
+                            max_center_num_exp,
+                            max_num_primitives))
+    {
+        fprintf(stderr,
+                "ERROR: balboa workspace too small for this basis or "
+                "derivative order.\n");
+        return -1;
+    }
 
     std::fill(&ao_local[0],
-              &ao_local[get_buffer_len(max_geo_order, num_points)],
+              &ao_local[get_layout_buffer_len(
+                  is_point_major, leading_dim, max_geo_order, num_points)],
               0.0);
-    assert(max_geo_order <= MAX_GEO_DIFF_ORDER);
 
-    int n = 0;
-    for (int ishell = 0; ishell < num_shells; ishell++)
+    double *px = workspace->px;
+    double *py = workspace->py;
+    double *pz = workspace->pz;
+    double *p2 = workspace->p2;
+    double *buffer = workspace->buffer;
+
+    // chunks where only a few points are within the extent of a shell
+    // are evaluated on the compacted points and scattered back
+    double *ao_compact = workspace->ao_compact;
+    double *pxc = workspace->pxc;
+    double *pyc = workspace->pyc;
+    double *pzc = workspace->pzc;
+    double *p2c = workspace->p2c;
+    int *close_index = workspace->close_index;
+
+    // primitive exponentials of the current center and chunk, computed
+    // when first needed; exp_row is -2 before that, -1 if all points
+    // underflowed, and the row in exp_table otherwise
+    double *exp_table = workspace->exp_table;
+    int *exp_row = workspace->exp_row;
+    double *exp_compact = workspace->exp_compact;
+    int *primitive_row = workspace->primitive_row;
+    int *primitive_row_compact = workspace->primitive_row_compact;
+
+    // tabulated radial functions, per point the mesh interval and the
+    // four cubic Hermite weights
+    int *spline_node = workspace->spline_node;
+    double *spline_weight = workspace->spline_weight;
+    double *spline_g = workspace->spline_g;
+
+    // AO i at point k of derivative slice g is at
+    // g * xoff + i * ao_step + k * point_step
+    int ao_step = is_point_major ? 1 : leading_dim;
+    int point_step = is_point_major ? leading_dim : 1;
+    int xoff = (is_point_major ? num_points : num_ao) * leading_dim;
+
+    for (int koff = 0; koff < num_points; koff += AO_CHUNK_LENGTH)
     {
-        int num_points_left = num_points;
+        int num_points_batch = std::min(AO_CHUNK_LENGTH, num_points - koff);
+        int num_points_padded = get_padded_length(num_points_batch);
 
-        for (int koff = 0; koff < num_points; koff += AO_CHUNK_LENGTH)
+        // distances are computed once per center and chunk
+        // and shared by all shells on this center
+        for (int icenter = 0; icenter < num_centers; icenter++)
         {
-            int num_points_batch = std::min(AO_CHUNK_LENGTH, num_points_left);
-
-            num_points_left -= num_points_batch;
-
-            int zoff = koff + shell_off[ishell] * num_points;
-            int xoff = num_ao * num_points;
-
-            ao_dispatch(max_geo_order,
-                        shell_l_quantum_numbers[ishell],
-                        shell_num_primitives[ishell],
-                        is_spherical,
-                        &primitive_exponents[n],
-                        &contraction_coefficients[n],
-                        num_points,
-                        num_points_batch,
-                        xoff,
-                        s,
-                        buffer,
-                        &shell_centers_coordinates[3 * ishell],
-                        shell_extent_squared[ishell],
-                        &x_coordinates_bohr[koff],
-                        &y_coordinates_bohr[koff],
-                        &z_coordinates_bohr[koff],
-                        px,
-                        py,
-                        pz,
-                        p2,
-                        &ao_local[zoff]);
+            if (center_shell_off[icenter] == center_shell_off[icenter + 1])
+                continue;
+
+            // shells on centers that are not differentiated only need
+            // the slices up to base_geo_order, the others stay zero
+            int geo_order = max_geo_order;
+            if (derv_centers != NULL)
+            {
+                geo_order = base_geo_order;
+                for (int c = 0; c < num_derv_centers; c++)
+                {
+                    if (derv_centers[c] == icenter)
+                        geo_order = max_geo_order;
+                }
+            }
+            int num_slices =
+                (geo_order + 1) * (geo_order + 2) * (geo_order + 3) / 6;
+
+            bool use_splines =
+                (spline_table != NULL and geo_order <= SPLINE_MAX_GEO_ORDER);
+
+            get_p2(num_points_batch,
+                   &center_coordinates_bohr[3 * icenter],
+                   &x_coordinates_bohr[koff],
+                   &y_coordinates_bohr[koff],
+                   &z_coordinates_bohr[koff],
+                   px,
+                   py,
+                   pz,
+                   p2);
+            // the kernels run over whole vectors, the padding
+            // repeats the last point
+            for (int k = num_points_batch; k < num_points_padded; k++)
+            {
+                px[k] = px[num_points_batch - 1];
+                py[k] = py[num_points_batch - 1];
+                pz[k] = pz[num_points_batch - 1];
+                p2[k] = p2[num_points_batch - 1];
+            }
+            std::fill(&exp_row[0], &exp_row[max_center_num_exp], -2);
+
+            if (use_splines)
+            {
+                double step = spline_step[icenter];
+                double r_max = spline_r_max[icenter];
+                int last = spline_num_nodes[icenter] - 1;
+                for (int k = 0; k < num_points_padded; k++)
+                {
+                    double r = sqrt(p2[k]);
+                    double x = sqrt(r) / step;
+                    int node = (int)x;
+                    if (r >= r_max or node >= last)
+                    {
+                        spline_node[k] = -1;
+                        continue;
+                    }
+                    double t = x - node;
+                    double *w = &spline_weight[4 * k];
+                    w[0] = (1.0 + 2.0 * t) * (1.0 - t) * (1.0 - t);
+                    w[1] = t * (1.0 - t) * (1.0 - t) * step;
+                    w[2] = t * t * (3.0 - 2.0 * t);
+                    w[3] = t * t * (t - 1.0) * step;
+                    spline_node[k] = node;
+                }
+            }
+
+            for (int i = center_shell_off[icenter];
+                 i < center_shell_off[icenter + 1];
+                 i++)
+            {
+                int ishell = center_shells[i];
+                int n = shell_primitive_off[ishell];
+
+                int deg = cartesian_deg[ishell];
+                if (is_spherical)
+                    deg = spherical_deg[ishell];
+
+                // points within the extent of the most diffuse primitive
+                // and their smallest distance; as before the whole chunk
+                // is skipped if no point is within the shell extent
+                int num_close = 0;
+                double p2_min = primitive_extent_squared[n];
+                bool shell_is_close = false;
+                for (int k = 0; k < num_points_batch; k++)
+                {
+                    if (p2[k] < primitive_extent_squared[n])
+                    {
+                        close_index[num_close] = k;
+                        num_close++;
+                        p2_min = std::min(p2_min, p2[k]);
+                    }
+                    if (p2[k] < shell_extent_squared[ishell])
+                        shell_is_close = true;
+                }
+                if (!shell_is_close)
+                    continue;
+
+                // primitives are sorted by decreasing extent,
+                // drop those that are negligible for all points
+                int num_primitives = shell_num_primitives[ishell];
+                while (num_primitives > 1 and
+                       primitive_extent_squared[n + num_primitives - 1] <
+                           p2_min)
+                {
+                    num_primitives--;
+                }
+
+                // shells whose table misses the accuracy sum the
+                // primitives
+                bool shell_uses_splines =
+                    (use_splines and spline_shell_off[ishell] >= 0);
+
+                double *radial = NULL;
+                double *radial_compact = NULL;
+                if (shell_uses_splines)
+                {
+                    radial = workspace->radial;
+                    radial_compact = workspace->radial_compact;
+                    get_spline_radial(ishell,
+                                      geo_order,
+                                      num_points_padded,
+                                      spline_node,
+                                      spline_weight,
+                                      px,
+                                      py,
+                                      pz,
+                                      spline_g,
+                                      radial);
+                }
+                else
+                {
+                    for (int j = 0; j < num_primitives; j++)
+                    {
+                        int u = primitive_exp_index[n + j];
+                        if (exp_row[u] == -2)
+                        {
+                            double *e = &exp_table[u * AO_CHUNK_LENGTH];
+                            double a = -primitive_exponents[n + j];
+                            bool is_nonzero = get_exp(
+                                ao_isa, num_points_padded, p2, 1.0, a, e);
+                            exp_row[u] = is_nonzero ? u : -1;
+                        }
+                        primitive_row[j] = exp_row[u];
+                    }
+                }
+
+                int zoff = shell_off[ishell] * ao_step + koff * point_step;
+
+                if (2 * num_close > num_points_batch)
+                {
+                    // the kernels only store AO-major, point-major AOs
+                    // are computed into ao_compact and transposed
+                    double *ao_shell = &ao_local[zoff];
+                    int ao_stride = leading_dim;
+                    int slice_stride = xoff;
+                    if (is_point_major)
+                    {
+                        ao_shell = ao_compact;
+                        ao_stride = AO_CHUNK_LENGTH;
+                        slice_stride = deg * AO_CHUNK_LENGTH;
+                    }
+                    ao_dispatch(ao_isa,
+                                geo_order,
+                                shell_l_quantum_numbers[ishell],
+                                num_primitives,
+                                is_spherical,
+                                &primitive_exponents[n],
+                                &contraction_coefficients[n],
+                                exp_table,
+                                primitive_row,
+                                radial,
+                                ao_stride,
+                                num_points_batch,
+                                slice_stride,
+                                buffer,
+                                shell_extent_squared[ishell],
+                                px,
+                                py,
+                                pz,
+                                p2,
+                                ao_shell);
+                    for (int g = 0; is_point_major and g < num_slices; g++)
+                    {
+                        for (int k = 0; k < num_points_batch; k++)
+                        {
+                            double *dst =
+                                &ao_local[zoff + g * xoff + k * leading_dim];
+                            for (int j = 0; j < deg; j++)
+                            {
+                                dst[j] = ao_compact[g * slice_stride +
+                                                    j * AO_CHUNK_LENGTH + k];
+                            }
+                        }
+                    }
+                    continue;
+                }
+
+                if (num_close == 0)
+                    continue;
+
+                // the padding repeats the last close point
+                int num_close_padded = get_padded_length(num_close);
+                for (int q = num_close; q < num_close_padded; q++)
+                {
+                    close_index[q] = close_index[num_close - 1];
+                }
+
+                for (int q = 0; q < num_close_padded; q++)
+                {
+                    pxc[q] = px[close_index[q]];
+                    pyc[q] = py[close_index[q]];
+                    pzc[q] = pz[close_index[q]];
+                    p2c[q] = p2[close_index[q]];
+                }
+                for (int g = 0; radial != NULL and g < num_slices; g++)
+                {
+                    for (int q = 0; q < num_close_padded; q++)
+                    {
+                        radial_compact[g * AO_CHUNK_LENGTH + q] =
+                            radial[g * AO_CHUNK_LENGTH + close_index[q]];
+                    }
+                }
+                for (int j = 0; radial == NULL and j < num_primitives; j++)
+                {
+                    primitive_row_compact[j] = -1;
+                    if (primitive_row[j] < 0)
+                        continue;
+                    const double *e =
+                        &exp_table[primitive_row[j] * AO_CHUNK_LENGTH];
+                    for (int q = 0; q < num_close_padded; q++)
+                    {
+                        exp_compact[j * AO_CHUNK_LENGTH + q] =
+                            e[close_index[q]];
+                    }
+                    primitive_row_compact[j] = j;
+                }
+
+                // in the compacted buffer AOs are AO_CHUNK_LENGTH apart
+                // and slices deg * AO_CHUNK_LENGTH
+                int xoff_compact = deg * AO_CHUNK_LENGTH;
+                std::fill(&ao_compact[0],
+                          &ao_compact[num_slices * xoff_compact],
+                          0.0);
+                ao_dispatch(ao_isa,
+                            geo_order,
+                            shell_l_quantum_numbers[ishell],
+                            num_primitives,
+                            is_spherical,
+                            &primitive_exponents[n],
+                            &contraction_coefficients[n],
+                            exp_compact,
+                            primitive_row_compact,
+                            radial_compact,
+                            AO_CHUNK_LENGTH,
+                            num_close,
+                            xoff_compact,
+                            buffer,
+                            shell_extent_squared[ishell],
+                            pxc,
+                            pyc,
+                            pzc,
+                            p2c,
+                            ao_compact);
+
+                for (int g = 0; g < num_slices; g++)
+                {
+                    for (int j = 0; j < deg; j++)
+                    {
+                        double *src =
+                            &ao_compact[g * xoff_compact + j * AO_CHUNK_LENGTH];
+                        double *dst = &ao_local[zoff + g * xoff + j * ao_step];
+                        for (int q = 0; q < num_close; q++)
+                        {
+                            dst[close_index[q] * point_step] = src[q];
+                        }
+                    }
+                }
+            }
         }
-        n += shell_num_primitives[ishell];
     }
 
+    delete temporary;
+
     return 0;
 }
 
@@ -402,8 +1244,14 @@ void Main::nullify()
     shell_l_quantum_numbers = NULL;
     center_coordinates_bohr = NULL;
     shell_centers = NULL;
-    shell_centers_coordinates = NULL;
     shell_extent_squared = NULL;
+    primitive_extent_squared = NULL;
+    center_shell_off = NULL;
+    center_shells = NULL;
+    shell_primitive_off = NULL;
+    primitive_exp_index = NULL;
+    max_center_num_exp = 0;
+    max_shell_deg = 0;
     cartesian_deg = NULL;
     shell_off = NULL;
     spherical_deg = NULL;
@@ -416,6 +1264,13 @@ void Main::nullify()
     primitive_exponents = NULL;
     contraction_coefficients = NULL;
     is_initialized = 0;
+    geo_offset = NULL;
+    geo_offset_size = 0;
+    spline_step = NULL;
+    spline_r_max = NULL;
+    spline_num_nodes = NULL;
+    spline_shell_off = NULL;
+    spline_table = NULL;
 }
 
 void Main::deallocate()
@@ -423,8 +1278,12 @@ void Main::deallocate()
     delete[] shell_l_quantum_numbers;
     delete[] center_coordinates_bohr;
     delete[] shell_centers;
-    delete[] shell_centers_coordinates;
     delete[] shell_extent_squared;
+    delete[] primitive_extent_squared;
+    delete[] center_shell_off;
+    delete[] center_shells;
+    delete[] shell_primitive_off;
+    delete[] primitive_exp_index;
     delete[] cartesian_deg;
     delete[] shell_off;
     delete[] spherical_deg;
@@ -433,4 +1292,9 @@ void Main::deallocate()
     delete[] primitive_exponents;
     delete[] contraction_coefficients;
     delete[] geo_offset;
+    delete[] spline_step;
+    delete[] spline_r_max;
+    delete[] spline_num_nodes;
+    delete[] spline_shell_off;
+    delete[] spline_table;
 }
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "Workspace.h"
+#include "ao_vector.h"
+
 class Main
 {
   public:
@@ -17,13 +20,38 @@ class Main
                   const double contraction_coefficients[]);
 
     int get_buffer_len(const int max_geo_order, const int num_points) const;
+    int get_aligned_leading_dim(const bool is_point_major,
+                                const int num_points) const;
+    int get_layout_buffer_len(const bool is_point_major,
+                              const int leading_dim,
+                              const int max_geo_order,
+                              const int num_points) const;
     int get_ao_center(const int i) const;
+    int get_num_shells() const;
+    int get_shell_off(const int i) const;
+    int get_spherical_transform(const int i, double coefficients[]) const;
     int get_geo_offset(const int i, const int j, const int k) const;
 
     int get_num_aos() const;
 
-    // buffer is not zeroed out inside get_ao
-    int get_ao(const int max_geo_order,
+    // 0 sums the primitives, a positive value tabulates the contracted
+    // radial functions on a mesh to this relative accuracy
+    int set_spline_accuracy(const double accuracy);
+
+    // scratch memory for get_ao with this basis
+    Workspace *new_workspace(const int max_geo_order) const;
+
+    // buffer is zeroed out inside get_ao; a NULL workspace allocates
+    // a temporary one; AO-major AOs are leading_dim apart, point-major
+    // points are leading_dim apart; with derv_centers, shells on other
+    // centers are evaluated up to base_geo_order only
+    int get_ao(Workspace *workspace,
+               const bool is_point_major,
+               const int leading_dim,
+               const int max_geo_order,
+               const int base_geo_order,
+               const int num_derv_centers,
+               const int derv_centers[],
                const int num_points,
                const double x_coordinates_bohr[],
                const double y_coordinates_bohr[],
@@ -38,6 +66,19 @@ class Main
     void deallocate();
 
     void transform_basis() const;
+    void tabulate_splines();
+    void get_workspace_size(int &max_l_quantum_number,
+                            int &max_num_primitives) const;
+    void get_spline_radial(const int ishell,
+                           const int max_geo_order,
+                           const int num_points_batch,
+                           const int spline_node[],
+                           const double spline_weight[],
+                           const double px[],
+                           const double py[],
+                           const double pz[],
+                           double g[],
+                           double radial[]) const;
 
     int num_centers;
     int num_shells;
@@ -47,8 +88,14 @@ class Main
     double *center_coordinates_bohr;
     int *shell_centers;
 
-    double *shell_centers_coordinates;
     double *shell_extent_squared;
+    double *primitive_extent_squared;
+    int max_shell_deg;
+    int *center_shell_off;
+    int *center_shells;
+    int *shell_primitive_off;
+    int *primitive_exp_index;
+    int max_center_num_exp;
     int *cartesian_deg;
     int *shell_off;
     int *spherical_deg;
@@ -62,4 +109,14 @@ class Main
     int is_initialized;
     int *geo_offset;
     int geo_offset_size;
+
+    double spline_accuracy;
+    double *spline_step;
+    double *spline_r_max;
+    int *spline_num_nodes;
+    int *spline_shell_off;
+    double *spline_table;
+
+    // instruction set of the kernels, chosen when the context is created
+    ao_isa_t ao_isa;
 };
@@ -0,0 +1,129 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Workspace.h"
+#include "ao_kernels.h"
+#include "balboa_parameters.h"
+
+const size_t ALIGNMENT = 64;
+
+static size_t aligned(const size_t num_bytes)
+{
+    return (num_bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+Workspace::Workspace(const int max_geo_order,
+                     const int max_l_quantum_number,
+                     const int max_shell_deg,
+                     const int max_center_num_exp,
+                     const int max_num_primitives)
+{
+    this->max_geo_order = max_geo_order;
+    this->max_l_quantum_number = max_l_quantum_number;
+    this->max_shell_deg = max_shell_deg;
+    this->max_center_num_exp = max_center_num_exp;
+    this->max_num_primitives = max_num_primitives;
+
+    const size_t CH = AO_CHUNK_LENGTH;
+    const size_t D = sizeof(double);
+    const size_t I = sizeof(int);
+    size_t num_slices = (max_geo_order + 1) * (max_geo_order + 2) *
+                        (max_geo_order + 3) / 6;
+
+    // in the order in which the arrays are laid out below
+    size_t len[20];
+    int n = 0;
+    len[n++] = aligned(CH * D);                               // px
+    len[n++] = aligned(CH * D);                               // py
+    len[n++] = aligned(CH * D);                               // pz
+    len[n++] = aligned(CH * D);                               // p2
+    len[n++] = aligned(max_center_num_exp * CH * D);          // exp_table
+    len[n++] = aligned(max_center_num_exp * I);               // exp_row
+    len[n++] = aligned(max_num_primitives * I);               // primitive_row
+    len[n++] = aligned(CH * I);                               // spline_node
+    len[n++] = aligned(4 * CH * D);                           // spline_weight
+    len[n++] = aligned((max_geo_order + 1) * CH * D);         // spline_g
+    len[n++] = aligned(num_slices * CH * D);                  // radial
+    len[n++] = aligned(CH * D);                               // pxc
+    len[n++] = aligned(CH * D);                               // pyc
+    len[n++] = aligned(CH * D);                               // pzc
+    len[n++] = aligned(CH * D);                               // p2c
+    len[n++] = aligned(CH * I);                               // close_index
+    len[n++] = aligned(max_num_primitives * CH * D);          // exp_compact
+    len[n++] = aligned(max_num_primitives * I); // primitive_row_compact
+    len[n++] = aligned(num_slices * CH * D);    // radial_compact
+    len[n++] = aligned(num_slices * max_shell_deg * CH * D);  // ao_compact
+
+    size_t buffer_len =
+        aligned(get_buffer_length(max_l_quantum_number, max_geo_order) * D);
+
+    size_t total = buffer_len;
+    for (int i = 0; i < n; i++)
+        total += len[i];
+
+    memory = new char[total + ALIGNMENT];
+    char *p = memory;
+    p += (ALIGNMENT - reinterpret_cast<uintptr_t>(p) % ALIGNMENT) % ALIGNMENT;
+
+    int i = 0;
+    px = reinterpret_cast<double *>(p);
+    p += len[i++];
+    py = reinterpret_cast<double *>(p);
+    p += len[i++];
+    pz = reinterpret_cast<double *>(p);
+    p += len[i++];
+    p2 = reinterpret_cast<double *>(p);
+    p += len[i++];
+    exp_table = reinterpret_cast<double *>(p);
+    p += len[i++];
+    exp_row = reinterpret_cast<int *>(p);
+    p += len[i++];
+    primitive_row = reinterpret_cast<int *>(p);
+    p += len[i++];
+    spline_node = reinterpret_cast<int *>(p);
+    p += len[i++];
+    spline_weight = reinterpret_cast<double *>(p);
+    p += len[i++];
+    spline_g = reinterpret_cast<double *>(p);
+    p += len[i++];
+    radial = reinterpret_cast<double *>(p);
+    p += len[i++];
+    pxc = reinterpret_cast<double *>(p);
+    p += len[i++];
+    pyc = reinterpret_cast<double *>(p);
+    p += len[i++];
+    pzc = reinterpret_cast<double *>(p);
+    p += len[i++];
+    p2c = reinterpret_cast<double *>(p);
+    p += len[i++];
+    close_index = reinterpret_cast<int *>(p);
+    p += len[i++];
+    exp_compact = reinterpret_cast<double *>(p);
+    p += len[i++];
+    primitive_row_compact = reinterpret_cast<int *>(p);
+    p += len[i++];
+    radial_compact = reinterpret_cast<double *>(p);
+    p += len[i++];
+    ao_compact = reinterpret_cast<double *>(p);
+    p += len[i++];
+    buffer = reinterpret_cast<double *>(p);
+}
+
+Workspace::~Workspace()
+{
+    delete[] memory;
+    memory = NULL;
+}
+
+bool Workspace::fits(const int max_geo_order,
+                     const int max_l_quantum_number,
+                     const int max_shell_deg,
+                     const int max_center_num_exp,
+                     const int max_num_primitives) const
+{
+    return (max_geo_order <= this->max_geo_order and
+            max_l_quantum_number <= this->max_l_quantum_number and
+            max_shell_deg <= this->max_shell_deg and
+            max_center_num_exp <= this->max_center_num_exp and
+            max_num_primitives <= this->max_num_primitives);
+}
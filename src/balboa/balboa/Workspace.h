@@ -0,0 +1,70 @@
+#pragma once
+
+// scratch memory of Main::get_ao for one thread, sized for one basis and
+// geometric derivatives up to max_geo_order; all arrays are 64-byte
+// aligned and carved from one allocation, the arrays that are touched
+// for every shell first and the kernel buffer last
+class Workspace
+{
+  public:
+    Workspace(const int max_geo_order,
+              const int max_l_quantum_number,
+              const int max_shell_deg,
+              const int max_center_num_exp,
+              const int max_num_primitives);
+    ~Workspace();
+
+    // whether it is large enough for these requirements
+    bool fits(const int max_geo_order,
+              const int max_l_quantum_number,
+              const int max_shell_deg,
+              const int max_center_num_exp,
+              const int max_num_primitives) const;
+
+    // distances of the points of the chunk to the current center
+    double *px;
+    double *py;
+    double *pz;
+    double *p2;
+
+    // the same for the close points of the current shell
+    double *pxc;
+    double *pyc;
+    double *pzc;
+    double *p2c;
+    int *close_index;
+
+    // primitive exponentials of the current center and chunk
+    double *exp_table;
+    int *exp_row;
+    double *exp_compact;
+    int *primitive_row;
+    int *primitive_row_compact;
+
+    // spline mesh intervals and weights
+    int *spline_node;
+    double *spline_weight;
+    double *spline_g;
+
+    // tabulated radial parts
+    double *radial;
+    double *radial_compact;
+
+    // AOs of one shell on the close points
+    double *ao_compact;
+
+    // Cartesian components times derivative slices of one shell
+    double *buffer;
+
+  private:
+    Workspace(const Workspace &rhs);            // not implemented
+    Workspace &operator=(const Workspace &rhs); // not implemented
+
+    int max_geo_order;
+    int max_l_quantum_number;
+    int max_shell_deg;
+    int max_center_num_exp;
+    int max_num_primitives;
+
+    char *memory;
+};
@@ -20,11 +20,21 @@ _lib = get_lib_handle(
     _include_dir
 )
 
+AO_MAJOR = _lib.BALBOA_AO_MAJOR
+POINT_MAJOR = _lib.BALBOA_POINT_MAJOR
+
 new_context = _lib.balboa_new_context
 free_context = _lib.balboa_free_context
 set_basis = _lib.balboa_set_basis
+set_spline_accuracy = _lib.balboa_set_spline_accuracy
 get_buffer_len = _lib.balboa_get_buffer_len
+new_workspace = _lib.balboa_new_workspace
+free_workspace = _lib.balboa_free_workspace
 get_ao = _lib.balboa_get_ao
+get_ao_on_centers = _lib.balboa_get_ao_on_centers
+get_aligned_leading_dim = _lib.balboa_get_aligned_leading_dim
+get_layout_buffer_len = _lib.balboa_get_layout_buffer_len
+get_ao_layout = _lib.balboa_get_ao_layout
 get_num_aos = _lib.balboa_get_num_aos
 get_ao_center = _lib.balboa_get_ao_center
 get_geo_offset = _lib.balboa_get_geo_offset
@@ -0,0 +1,317 @@
+// AO kernel templates, included by ao_kernels.cpp once per instruction
+// set inside its own namespace with AO_KERNEL_TARGET set to the matching
+// target attribute; therefore no include guard and no includes here
+
+// vec r = s * vec a
+AO_KERNEL_TARGET inline void vec_scale(const int num_points,
+                                       const double s,
+                                       const double *__restrict__ a,
+                                       double *__restrict__ r)
+{
+    for (int k = 0; k < num_points; k++)
+    {
+        r[k] = s * a[k];
+    }
+}
+
+// vec r = vec r + s * vec a
+AO_KERNEL_TARGET inline void vec_daxpy(const int num_points,
+                                       const double s,
+                                       const double *__restrict__ a,
+                                       double *__restrict__ r)
+{
+    for (int k = 0; k < num_points; k++)
+    {
+        r[k] += s * a[k];
+    }
+}
+
+// the following loops run over whole vectors of AO_VECTOR_LENGTH points,
+// num_points is a multiple of it, so that there is no remainder loop
+
+// vec r = vec p * vec a
+AO_KERNEL_TARGET inline void get_pa(const int num_points,
+                                    const double *__restrict__ a,
+                                    const double *__restrict__ p,
+                                    double *__restrict__ r)
+{
+    for (int kv = 0; kv < num_points; kv += AO_VECTOR_LENGTH)
+    {
+        for (int k = kv; k < kv + AO_VECTOR_LENGTH; k++)
+        {
+            r[k] = p[k] * a[k];
+        }
+    }
+}
+
+// vec r = vec p * vec a + s * vec b
+AO_KERNEL_TARGET inline void get_pa_plus_sb(const int num_points,
+                                            const double *__restrict__ a,
+                                            const double *__restrict__ p,
+                                            const double s,
+                                            const double *__restrict__ b,
+                                            double *__restrict__ r)
+{
+    for (int kv = 0; kv < num_points; kv += AO_VECTOR_LENGTH)
+    {
+        for (int k = kv; k < kv + AO_VECTOR_LENGTH; k++)
+        {
+            r[k] = p[k] * a[k] + s * b[k];
+        }
+    }
+}
+
+// buffer slice geo_ijk of x^0 y^0 z^0 += the derivatives of
+// c exp(a p^2) for all slices up to order G, with the exponentials
+// exp(a p^2) in e
+template <int G>
+AO_KERNEL_TARGET inline void add_primitive(const int num_points,
+                                           const double a,
+                                           const double c,
+                                           const double *__restrict__ e,
+                                           const double *__restrict__ px,
+                                           const double *__restrict__ py,
+                                           const double *__restrict__ pz,
+                                           double *__restrict__ buffer)
+{
+    const int CH = AO_CHUNK_LENGTH;
+
+    for (int kv = 0; kv < num_points; kv += AO_VECTOR_LENGTH)
+    {
+        for (int k = kv; k < kv + AO_VECTOR_LENGTH; k++)
+        {
+            // d^g/dx^g exp(a x^2) = fx_g exp(a x^2) with
+            // fx_g = fx_1 fx_(g-1) + 2 (g-1) a fx_(g-2)
+            double fx[G + 1];
+            double fy[G + 1];
+            double fz[G + 1];
+            fx[0] = 1.0;
+            fy[0] = 1.0;
+            fz[0] = 1.0;
+            if (G > 0)
+            {
+                fx[1] = 2.0 * a * px[k];
+                fy[1] = 2.0 * a * py[k];
+                fz[1] = 2.0 * a * pz[k];
+            }
+#pragma GCC unroll 8
+            for (int g = 2; g <= G; g++)
+            {
+                fx[g] = fx[g - 1] * fx[1] + 2.0 * (g - 1) * a * fx[g - 2];
+                fy[g] = fy[g - 1] * fy[1] + 2.0 * (g - 1) * a * fy[g - 2];
+                fz[g] = fz[g - 1] * fz[1] + 2.0 * (g - 1) * a * fz[g - 2];
+            }
+            // c exp(a p^2) is folded into the x factors
+            const double t = c * e[k];
+#pragma GCC unroll 8
+            for (int g = 0; g <= G; g++)
+            {
+                fx[g] *= t;
+            }
+
+#pragma GCC unroll 8
+            for (int g = 0; g <= G; g++)
+            {
+#pragma GCC unroll 8
+                for (int gx = g; gx >= 0; gx--)
+                {
+#pragma GCC unroll 8
+                    for (int gy = g - gx; gy >= 0; gy--)
+                    {
+                        int gz = g - gx - gy;
+                        buffer[get_ijk_index(gx, gy, gz) * CH + k] +=
+                            fx[gx] * fy[gy] * fz[gz];
+                    }
+                }
+            }
+        }
+    }
+}
+
+// AOs of one shell of type L for one chunk and all derivative slices up
+// to order G; same arguments as ao_dispatch, see there
+template <int L, int G>
+AO_KERNEL_TARGET void get_ao_kernel(const int num_primitives,
+                                    const bool is_spherical,
+                                    const double primitive_exponents[],
+                                    const double contraction_coefficients[],
+                                    const double primitive_exp[],
+                                    const int primitive_exp_row[],
+                                    const double radial[],
+                                    const int num_points,
+                                    const int num_points_batch,
+                                    const int xoff,
+                                    double buffer[],
+                                    const double extent_squared,
+                                    const double px[],
+                                    const double py[],
+                                    const double pz[],
+                                    const double p2[],
+                                    double ao_000[])
+{
+    // all points are computed up to the padded length nv,
+    // only the first n are written to ao_000
+    const int n = num_points_batch;
+    const int nv = get_padded_length(num_points_batch);
+    const int CH = AO_CHUNK_LENGTH;
+
+    // number of derivative slices, buffer[(c*NG + g)*CH] holds
+    // Cartesian component c in slice g
+    const int NG = (G + 1) * (G + 2) * (G + 3) / 6;
+
+    // screening
+    if (not calculate_chunk(n, extent_squared, p2))
+        return;
+
+    // radial parts tabulated by the caller replace the primitive sum
+    if (radial != NULL)
+    {
+        for (int g = 0; g < NG; g++)
+        {
+            std::copy(&radial[g * CH], &radial[g * CH + nv], &buffer[g * CH]);
+        }
+    }
+    else
+    {
+        std::fill(&buffer[0], &buffer[NG * CH], 0.0);
+        for (int i = 0; i < num_primitives; i++)
+        {
+            // all points underflowed
+            if (primitive_exp_row[i] < 0)
+                continue;
+            add_primitive<G>(nv,
+                             -primitive_exponents[i],
+                             contraction_coefficients[i],
+                             &primitive_exp[primitive_exp_row[i] * CH],
+                             px,
+                             py,
+                             pz,
+                             buffer);
+        }
+    }
+
+    // x^i y^j z^k from the component one order lower along the first
+    // nonzero of i, j, k, using d/dx (x f) = f + x df/dx
+    for (int l = 1; l <= L; l++)
+    {
+        for (int i = l; i >= 0; i--)
+        {
+            for (int j = l - i; j >= 0; j--)
+            {
+                int k = l - i - j;
+                int m = (i > 0) ? 0 : ((j > 0) ? 1 : 2);
+                const double *p = (m == 0) ? px : ((m == 1) ? py : pz);
+                int r_off = get_ijk_index(i, j, k) * NG;
+                int a_off = get_ijk_index(i - (m == 0),
+                                          j - (m == 1),
+                                          k - (m == 2)) *
+                            NG;
+                for (int g = 0; g <= G; g++)
+                {
+                    for (int gx = g; gx >= 0; gx--)
+                    {
+                        for (int gy = g - gx; gy >= 0; gy--)
+                        {
+                            int gz = g - gx - gy;
+                            int gm = (m == 0) ? gx : ((m == 1) ? gy : gz);
+                            int ig = get_ijk_index(gx, gy, gz);
+                            double *r = &buffer[(r_off + ig) * CH];
+                            const double *a = &buffer[(a_off + ig) * CH];
+                            if (gm == 0)
+                            {
+                                get_pa(nv, a, p, r);
+                                continue;
+                            }
+                            int ib = get_ijk_index(gx - (m == 0),
+                                                   gy - (m == 1),
+                                                   gz - (m == 2));
+                            const double *b = &buffer[(a_off + ib) * CH];
+                            get_pa_plus_sb(nv, a, p, gm, b, r);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    const int c_off = L * (L + 1) * (L + 2) / 6;
+    const int nc = (L + 1) * (L + 2) / 2;
+
+    // s and p functions are the same in both bases
+    if (L < 2 or not is_spherical)
+    {
+        for (int g = 0; g < NG; g++)
+        {
+            for (int c = 0; c < nc; c++)
+            {
+                const double *a = &buffer[((c_off + c) * NG + g) * CH];
+                std::copy(&a[0], &a[n], &ao_000[g * xoff + c * num_points]);
+            }
+        }
+        return;
+    }
+
+    // one pass per derivative slice and spherical component
+    // over the nonzero Cartesian coefficients
+    const int ns = 2 * L + 1;
+    const double *t = get_cs_trans(L);
+    for (int g = 0; g < NG; g++)
+    {
+        for (int is = 0; is < ns; is++)
+        {
+            double *r = &ao_000[g * xoff + is * num_points];
+            bool is_first = true;
+            for (int c = 0; c < nc; c++)
+            {
+                double f = t[c * ns + is];
+                if (f == 0.0)
+                    continue;
+                const double *a = &buffer[((c_off + c) * NG + g) * CH];
+                if (is_first)
+                {
+                    vec_scale(n, f, a, r);
+                    is_first = false;
+                }
+                else
+                {
+                    vec_daxpy(n, f, a, r);
+                }
+            }
+        }
+    }
+}
+
+// instantiates the kernels for all L <= MAX_L_VALUE and G <= max order
+template <int L, int G> struct ao_kernel_fill
+{
+    static void fill(ao_kernel_table &table)
+    {
+        ao_kernel_fill<L - 1, G>::fill(table);
+        table.kernel[G * (MAX_L_VALUE + 1) + L] = &get_ao_kernel<L, G>;
+    }
+};
+
+template <int G> struct ao_kernel_fill<-1, G>
+{
+    static void fill(ao_kernel_table &table)
+    {
+        ao_kernel_fill<MAX_L_VALUE, G - 1>::fill(table);
+    }
+};
+
+template <int L> struct ao_kernel_fill<L, -1>
+{
+    static void fill(ao_kernel_table &) {}
+};
+
+template <> struct ao_kernel_fill<-1, -1>
+{
+    static void fill(ao_kernel_table &) {}
+};
+
+inline ao_kernel_table get_ao_kernel_table()
+{
+    ao_kernel_table table;
+    ao_kernel_fill<MAX_L_VALUE, MAX_GEO_DIFF_ORDER>::fill(table);
+    return table;
+}
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <iostream>
+#include <stdlib.h> /* exit */
+
+#include "ao_kernels.h"
+#include "balboa_parameters.h"
+
+typedef void (*ao_kernel_t)(const int,
+                            const bool,
+                            const double[],
+                            const double[],
+                            const double[],
+                            const int[],
+                            const double[],
+                            const int,
+                            const int,
+                            const int,
+                            double[],
+                            const double,
+                            const double[],
+                            const double[],
+                            const double[],
+                            const double[],
+                            double[]);
+
+// indexed by G*(MAX_L_VALUE + 1) + L
+struct ao_kernel_table
+{
+    ao_kernel_t kernel[(MAX_GEO_DIFF_ORDER + 1) * (MAX_L_VALUE + 1)];
+};
+
+// the same kernels compiled for each instruction set, in namespaces of
+// their own so that the instantiations do not get mixed up at link time
+#define AO_KERNEL_TARGET
+namespace ao_generic
+{
+#include "ao_kernel_templates.h"
+}
+#undef AO_KERNEL_TARGET
+
+#if defined(__GNUC__) && defined(__x86_64__)
+
+#define AO_KERNEL_TARGET __attribute__((target("avx2,fma")))
+namespace ao_avx2
+{
+#include "ao_kernel_templates.h"
+}
+#undef AO_KERNEL_TARGET
+
+#define AO_KERNEL_TARGET __attribute__((target("avx512f,avx2,fma")))
+namespace ao_avx512
+{
+#include "ao_kernel_templates.h"
+}
+#undef AO_KERNEL_TARGET
+
+#endif
+
+static const ao_kernel_table &ao_kernels(const ao_isa_t isa)
+{
+    static const ao_kernel_table generic = ao_generic::get_ao_kernel_table();
+#if defined(__GNUC__) && defined(__x86_64__)
+    static const ao_kernel_table avx2 = ao_avx2::get_ao_kernel_table();
+    static const ao_kernel_table avx512 = ao_avx512::get_ao_kernel_table();
+    if (isa == AO_ISA_AVX512)
+        return avx512;
+    if (isa == AO_ISA_AVX2)
+        return avx2;
+#endif
+    return generic;
+}
+
+void ao_dispatch(const ao_isa_t isa,
+                 const int max_geo_order,
+                 const int shell_l_quantum_number,
+                 const int num_primitives,
+                 const bool is_spherical,
+                 const double primitive_exponents[],
+                 const double contraction_coefficients[],
+                 const double primitive_exp[],
+                 const int primitive_exp_row[],
+                 const double radial[],
+                 const int num_points,
+                 const int num_points_batch,
+                 const int xoff,
+                 double buffer[],
+                 const double extent_squared,
+                 const double px[],
+                 const double py[],
+                 const double pz[],
+                 const double p2[],
+                 double ao_000[])
+{
+    if (max_geo_order < 0 or max_geo_order > MAX_GEO_DIFF_ORDER)
+    {
+        std::cout << "ERROR: get_ao order too high";
+        exit(1);
+    }
+    if (shell_l_quantum_number < 0 or shell_l_quantum_number > MAX_L_VALUE)
+    {
+        std::cout << "error: order too high";
+        exit(1);
+    }
+
+    int i = max_geo_order * (MAX_L_VALUE + 1) + shell_l_quantum_number;
+    ao_kernel_t kernel = ao_kernels(isa).kernel[i];
+
+    kernel(num_primitives,
+           is_spherical,
+           primitive_exponents,
+           contraction_coefficients,
+           primitive_exp,
+           primitive_exp_row,
+           radial,
+           num_points,
+           num_points_batch,
+           xoff,
+           buffer,
+           extent_squared,
+           px,
+           py,
+           pz,
+           p2,
+           ao_000);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "ao_vector.h"
+#include "balboa_parameters.h"
+#include "cs_trans.h"
+
+// AO kernels, one specialization per shell type L and geometric
+// derivative order G; the templates are in ao_kernel_templates.h
+
+// the kernels compute whole vectors of this many points, shorter chunks
+// are padded; 8 doubles fill one AVX-512 register
+const int AO_VECTOR_LENGTH = 8;
+
+static_assert(AO_CHUNK_LENGTH % AO_VECTOR_LENGTH == 0,
+              "AO_CHUNK_LENGTH has to be a multiple of AO_VECTOR_LENGTH");
+
+// num_points rounded up to whole vectors
+inline int get_padded_length(const int num_points)
+{
+    return (num_points + AO_VECTOR_LENGTH - 1) / AO_VECTOR_LENGTH *
+           AO_VECTOR_LENGTH;
+}
+
+// position of x^i y^j z^k among all components up to order i + j + k,
+// in the order 000, 100, 010, 001, 200, 110, 101, 020, 011, 002, ...
+// this numbers both the Cartesian components and the derivative slices
+inline int get_ijk_index(const int i, const int j, const int k)
+{
+    int l = i + j + k;
+    return l * (l + 1) * (l + 2) / 6 + (l - i) * (l - i + 1) / 2 + k;
+}
+
+// length of the intermediate buffer of the kernels, the components
+// x^i y^j z^k for all orders up to max_l_quantum_number times all
+// derivative slices up to max_geo_order
+inline int get_buffer_length(const int max_l_quantum_number,
+                             const int max_geo_order)
+{
+    int l = max_l_quantum_number;
+    int g = max_geo_order;
+    return (l + 1) * (l + 2) * (l + 3) / 6 * (g + 1) * (g + 2) * (g + 3) / 6 *
+           AO_CHUNK_LENGTH;
+}
+
+// AOs of one shell for one chunk of num_points_batch <= AO_CHUNK_LENGTH
+// points; the AO of component j in slice g is written to
+// ao_000[g*xoff + j*num_points], px, py, pz, and p2 are the distances of
+// the points to the shell center, radial (or NULL) the radial slices
+// tabulated by the caller, and primitive_exp_row the rows of the
+// primitive exponentials in primitive_exp (negative if all underflowed);
+// these inputs have to hold finite values up to the padded length
+// get_padded_length(num_points_batch), e.g. copies of the last point;
+// isa selects the build of the kernels
+void ao_dispatch(const ao_isa_t isa,
+                 const int max_geo_order,
+                 const int shell_l_quantum_number,
+                 const int num_primitives,
+                 const bool is_spherical,
+                 const double primitive_exponents[],
+                 const double contraction_coefficients[],
+                 const double primitive_exp[],
+                 const int primitive_exp_row[],
+                 const double radial[],
+                 const int num_points,
+                 const int num_points_batch,
+                 const int xoff,
+                 double buffer[],
+                 const double extent_squared,
+                 const double px[],
+                 const double py[],
+                 const double pz[],
+                 const double p2[],
+                 double ao_000[]);
@@ -1,133 +1,237 @@
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "ao_vector.h"
 #include "balboa_parameters.h"
 
-// vec r = vec p * vec a
-void get_pa(const int num_points,
-            const double *__restrict__ a,
-            const double *__restrict__ p,
-            double *__restrict__ r)
-{
-    for (int k = 0; k < num_points; k++)
-    {
-        r[k] = p[k] * a[k];
-    }
-}
+// exp(x) = 2^n exp(r) with n = round(x/ln 2) and |r| <= ln(2)/2,
+// exp(r) by a Taylor polynomial whose degree follows from EXP_ACCURACY;
+// arguments below the underflow threshold give exactly zero
+#define EXP_UNDERFLOW -708.39
+#define EXP_MAX_DEGREE 16
 
-// vec r = vec p * vec a
-void get_pa_block(const double *__restrict__ a,
-                  const double *__restrict__ p,
-                  double *__restrict__ r)
+struct exp_polynomial
 {
-    for (int k = 0; k < AO_CHUNK_LENGTH; k++)
-    {
-        r[k] = p[k] * a[k];
-    }
-}
+    int degree;
+    double coef[EXP_MAX_DEGREE + 1];
+};
 
-// vec r = vec p * vec a + vec b
-void get_pa_plus_b(const int num_points,
-                   const double *__restrict__ a,
-                   const double *__restrict__ p,
-                   const double *__restrict__ b,
-                   double *__restrict__ r)
+static exp_polynomial get_exp_polynomial()
 {
-    for (int k = 0; k < num_points; k++)
+    exp_polynomial poly;
+    double r = 0.5 * M_LN2;
+    double term = 1.0;
+    poly.coef[0] = 1.0;
+    poly.degree = EXP_MAX_DEGREE;
+    for (int j = 1; j <= EXP_MAX_DEGREE; j++)
     {
-        r[k] = p[k] * a[k] + b[k];
+        poly.coef[j] = poly.coef[j - 1] / j;
+        term *= r / j;
+        // term is now the largest contribution of degree j
+        if (term * r / (j + 1) < EXP_ACCURACY)
+        {
+            poly.degree = j;
+            break;
+        }
     }
+    return poly;
 }
 
-// vec r = vec p * vec a + vec b
-void get_pa_plus_b_block(const double *__restrict__ a,
-                         const double *__restrict__ p,
-                         const double *__restrict__ b,
-                         double *__restrict__ r)
+static const exp_polynomial &exp_poly()
 {
-    for (int k = 0; k < AO_CHUNK_LENGTH; k++)
-    {
-        r[k] = p[k] * a[k] + b[k];
-    }
+    static const exp_polynomial poly = get_exp_polynomial();
+    return poly;
 }
 
-// vec r = vec p * vec a + s * vec b
-void get_pa_plus_sb(const int num_points,
-                    const double *__restrict__ a,
-                    const double *__restrict__ p,
-                    const double s,
-                    const double *__restrict__ b,
-                    double *__restrict__ r)
+// generic version with libm exp
+static bool get_exp_generic(const int num_points,
+                            const double *__restrict__ p2,
+                            const double c,
+                            const double a,
+                            double *__restrict__ s)
 {
+    bool is_nonzero = false;
     for (int k = 0; k < num_points; k++)
     {
-        r[k] = p[k] * a[k] + s * b[k];
+        double x = a * p2[k];
+        if (x < EXP_UNDERFLOW)
+        {
+            s[k] = 0.0;
+        }
+        else
+        {
+            s[k] = c * exp(x);
+            is_nonzero = true;
+        }
     }
+    return is_nonzero;
 }
 
-// vec r = vec p * vec a + s * vec b
-void get_pa_plus_sb_block(const double *__restrict__ a,
-                          const double *__restrict__ p,
-                          const double s,
-                          const double *__restrict__ b,
-                          double *__restrict__ r)
-{
-    for (int k = 0; k < AO_CHUNK_LENGTH; k++)
-    {
-        r[k] = p[k] * a[k] + s * b[k];
-    }
-}
+#if defined(__GNUC__) && defined(__x86_64__)
+
+#include <immintrin.h>
+
+#define LN2_HI 6.93147180369123816490e-01
+#define LN2_LO 1.90821492927058770002e-10
 
-void get_exp(const int num_points,
+// 0x1.8p52, adding it to an integer-valued double leaves the integer
+// in the low bits of the mantissa
+#define EXP_MAGIC 6755399441055744.0
+
+__attribute__((target("avx2,fma"))) static bool
+get_exp_avx2(const int num_points,
              const double *__restrict__ p2,
              const double c,
              const double a,
              double *__restrict__ s)
 {
-    double b1, b2;
+    const exp_polynomial &poly = exp_poly();
 
-    for (int k = 0; k < num_points; k++)
+    const __m256d va = _mm256_set1_pd(a);
+    const __m256d vc = _mm256_set1_pd(c);
+    const __m256d under = _mm256_set1_pd(EXP_UNDERFLOW);
+    const __m256d log2e = _mm256_set1_pd(M_LOG2E);
+    const __m256d ln2_hi = _mm256_set1_pd(LN2_HI);
+    const __m256d ln2_lo = _mm256_set1_pd(LN2_LO);
+    const __m256d magic = _mm256_set1_pd(EXP_MAGIC);
+    const __m256i bias = _mm256_set1_epi64x(1023);
+
+    int is_nonzero = 0;
+    int k = 0;
+    for (; k + 4 <= num_points; k += 4)
     {
-        b1 = a * p2[k];
-        b2 = exp(b1);
-        s[k] = c * b2;
+        __m256d x = _mm256_mul_pd(va, _mm256_loadu_pd(&p2[k]));
+        __m256d keep = _mm256_cmp_pd(x, under, _CMP_GE_OQ);
+        int m = _mm256_movemask_pd(keep);
+        if (m == 0)
+        {
+            _mm256_storeu_pd(&s[k], _mm256_setzero_pd());
+            continue;
+        }
+        is_nonzero |= m;
+        x = _mm256_max_pd(x, under);
+        // adding magic rounds to the nearest integer
+        __m256d t = _mm256_fmadd_pd(x, log2e, magic);
+        __m256d n = _mm256_sub_pd(t, magic);
+        __m256d r = _mm256_fnmadd_pd(n, ln2_hi, x);
+        r = _mm256_fnmadd_pd(n, ln2_lo, r);
+        __m256d e = _mm256_set1_pd(poly.coef[poly.degree]);
+        for (int j = poly.degree - 1; j >= 0; j--)
+            e = _mm256_fmadd_pd(e, r, _mm256_set1_pd(poly.coef[j]));
+        __m256i bits = _mm256_castpd_si256(t);
+        bits = _mm256_slli_epi64(_mm256_add_epi64(bits, bias), 52);
+        e = _mm256_mul_pd(e, _mm256_castsi256_pd(bits));
+        e = _mm256_and_pd(_mm256_mul_pd(vc, e), keep);
+        _mm256_storeu_pd(&s[k], e);
     }
+
+    // remaining points
+    if (get_exp_generic(num_points - k, &p2[k], c, a, &s[k]))
+        is_nonzero = 1;
+
+    return (is_nonzero != 0);
 }
 
-void get_exp_block(const double *__restrict__ p2,
-                   const double c,
-                   const double a,
-                   double *__restrict__ s)
+// same as the AVX2 version with 8 points at a time and a masked tail
+__attribute__((target("avx512f"))) static bool
+get_exp_avx512(const int num_points,
+               const double *__restrict__ p2,
+               const double c,
+               const double a,
+               double *__restrict__ s)
 {
-    double b1, b2;
+    const exp_polynomial &poly = exp_poly();
 
-    for (int k = 0; k < AO_CHUNK_LENGTH; k++)
+    const __m512d va = _mm512_set1_pd(a);
+    const __m512d vc = _mm512_set1_pd(c);
+    const __m512d under = _mm512_set1_pd(EXP_UNDERFLOW);
+    const __m512d log2e = _mm512_set1_pd(M_LOG2E);
+    const __m512d ln2_hi = _mm512_set1_pd(LN2_HI);
+    const __m512d ln2_lo = _mm512_set1_pd(LN2_LO);
+    const __m512d magic = _mm512_set1_pd(EXP_MAGIC);
+    const __m512i bias = _mm512_set1_epi64(1023);
+
+    __mmask8 is_nonzero = 0;
+    for (int k = 0; k < num_points; k += 8)
     {
-        b1 = a * p2[k];
-        b2 = exp(b1);
-        s[k] = c * b2;
+        int rest = num_points - k;
+        __mmask8 mask = (rest >= 8) ? (__mmask8)0xff
+                                    : (__mmask8)((1u << rest) - 1u);
+        __m512d x =
+            _mm512_mul_pd(va, _mm512_maskz_loadu_pd(mask, &p2[k]));
+        __mmask8 keep = _mm512_mask_cmp_pd_mask(mask, x, under, _CMP_GE_OQ);
+        if (keep == 0)
+        {
+            _mm512_mask_storeu_pd(&s[k], mask, _mm512_setzero_pd());
+            continue;
+        }
+        is_nonzero |= keep;
+        x = _mm512_mask_blend_pd(keep, under, x);
+        __m512d t = _mm512_fmadd_pd(x, log2e, magic);
+        __m512d n = _mm512_sub_pd(t, magic);
+        __m512d r = _mm512_fnmadd_pd(n, ln2_hi, x);
+        r = _mm512_fnmadd_pd(n, ln2_lo, r);
+        __m512d e = _mm512_set1_pd(poly.coef[poly.degree]);
+        for (int j = poly.degree - 1; j >= 0; j--)
+            e = _mm512_fmadd_pd(e, r, _mm512_set1_pd(poly.coef[j]));
+        // 2^n, zero for the lanes that underflow
+        __m512i bits = _mm512_castpd_si512(t);
+        bits = _mm512_maskz_slli_epi64(keep, _mm512_add_epi64(bits, bias), 52);
+        e = _mm512_mul_pd(e, _mm512_castsi512_pd(bits));
+        e = _mm512_mul_pd(vc, e);
+        _mm512_mask_storeu_pd(&s[k], mask, e);
     }
+
+    return (is_nonzero != 0);
 }
 
-void vec_daxpy(const int num_points,
-               const double s,
-               const double *__restrict__ a,
-               double *__restrict__ r)
+#endif
+
+ao_isa_t get_ao_isa()
 {
-    for (int k = 0; k < num_points; k++)
+    ao_isa_t isa = AO_ISA_GENERIC;
+#if defined(__GNUC__) && defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        isa = AO_ISA_AVX512;
+    else if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma"))
+        isa = AO_ISA_AVX2;
+#endif
+    const char *requested = getenv("BALBOA_ISA");
+    if (requested != NULL)
     {
-        r[k] += s * a[k];
+        if (strcmp(requested, "generic") == 0)
+            isa = AO_ISA_GENERIC;
+        else if (strcmp(requested, "avx2") == 0 and isa == AO_ISA_AVX512)
+            isa = AO_ISA_AVX2;
     }
+    return isa;
 }
 
-void vec_daxpy_block(const double s,
-                     const double *__restrict__ a,
-                     double *__restrict__ r)
+bool get_exp(const ao_isa_t isa,
+             const int num_points,
+             const double *__restrict__ p2,
+             const double c,
+             const double a,
+             double *__restrict__ s)
 {
-    for (int k = 0; k < AO_CHUNK_LENGTH; k++)
-    {
-        r[k] += s * a[k];
-    }
+#if defined(__GNUC__) && defined(__x86_64__)
+    if (isa == AO_ISA_AVX512)
+        return get_exp_avx512(num_points, p2, c, a, s);
+    if (isa == AO_ISA_AVX2)
+        return get_exp_avx2(num_points, p2, c, a, s);
+#endif
+    return get_exp_generic(num_points, p2, c, a, s);
+}
+
+bool get_exp_block(const ao_isa_t isa,
+                   const double *__restrict__ p2,
+                   const double c,
+                   const double a,
+                   double *__restrict__ s)
+{
+    return get_exp(isa, AO_CHUNK_LENGTH, p2, c, a, s);
 }
 
 void get_p2(const int num_points,
@@ -180,16 +284,3 @@ bool calculate_chunk(const int num_points,
     }
     return false;
 }
-
-bool calculate_chunk_block(const double extent_squared,
-                           const double *__restrict__ p2)
-{
-    for (int k = 0; k < AO_CHUNK_LENGTH; k++)
-    {
-        if (p2[k] < extent_squared)
-        {
-            return true;
-        }
-    }
-    return false;
-}
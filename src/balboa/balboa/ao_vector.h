@@ -1,64 +1,33 @@
 #pragma once
 
-// vec r = vec p * vec a
-void get_pa(const int num_points,
-            const double *__restrict__ a,
-            const double *__restrict__ p,
-            double *__restrict__ r);
-
-// vec r = vec p * vec a
-void get_pa_block(const double *__restrict__ a,
-                  const double *__restrict__ p,
-                  double *__restrict__ r);
-
-// vec r = vec p * vec a + vec b
-void get_pa_plus_b(const int num_points,
-                   const double *__restrict__ a,
-                   const double *__restrict__ p,
-                   const double *__restrict__ b,
-                   double *__restrict__ r);
-
-// vec r = vec p * vec a + vec b
-void get_pa_plus_b_block(const double *__restrict__ a,
-                         const double *__restrict__ p,
-                         const double *__restrict__ b,
-                         double *__restrict__ r);
-
-// vec r = vec p * vec a + s * vec b
-void get_pa_plus_sb(const int num_points,
-                    const double *__restrict__ a,
-                    const double *__restrict__ p,
-                    const double s,
-                    const double *__restrict__ b,
-                    double *__restrict__ r);
-
-// vec r = vec p * vec a + s * vec b
-void get_pa_plus_sb_block(const double *__restrict__ a,
-                          const double *__restrict__ p,
-                          const double s,
-                          const double *__restrict__ b,
-                          double *__restrict__ r);
-
-void get_exp(const int num_points,
+// instruction sets for which the vectorized kernels are built,
+// AO_ISA_GENERIC is whatever the compiler targets by default
+enum ao_isa_t
+{
+    AO_ISA_GENERIC,
+    AO_ISA_AVX2,
+    AO_ISA_AVX512
+};
+
+// highest instruction set supported by this CPU; the environment
+// variable BALBOA_ISA (generic or avx2) can lower it
+ao_isa_t get_ao_isa();
+
+// vec s = c * exp(a * vec p2), returns false if all of s underflowed
+// to zero so that the caller can skip the primitive
+bool get_exp(const ao_isa_t isa,
+             const int num_points,
              const double *__restrict__ p2,
              const double c,
              const double a,
              double *__restrict__ s);
 
-void get_exp_block(const double *__restrict__ p2,
+bool get_exp_block(const ao_isa_t isa,
+                   const double *__restrict__ p2,
                    const double c,
                    const double a,
                    double *__restrict__ s);
 
-void vec_daxpy(const int num_points,
-               const double s,
-               const double *__restrict__ a,
-               double *__restrict__ r);
-
-void vec_daxpy_block(const double s,
-                     const double *__restrict__ a,
-                     double *__restrict__ r);
-
 void get_p2(const int num_points,
             const double *__restrict__ shell_centers_coordinates,
             const double *__restrict__ x_coordinates_bohr,
@@ -82,5 +51,3 @@ bool calculate_chunk(const int num_points,
                      const double extent_squared,
                      const double *__restrict__ p2);
 
-bool calculate_chunk_block(const double extent_squared,
-                           const double *__restrict__ p2);
@@ -13,6 +13,19 @@ extern "C" {
 struct balboa_context_s;
 typedef struct balboa_context_s balboa_context_t;
 
+struct balboa_workspace_s;
+typedef struct balboa_workspace_s balboa_workspace_t;
+
+/* order of the AOs written by balboa_get_ao_layout; with leading
+   dimension ld and s = balboa_get_geo_offset(...) / num_aos the index
+   of a derivative slice, AO i at point k is at
+   AO-major:    (s * num_aos + i) * ld + k      with ld >= num_points
+   point-major: (s * num_points + k) * ld + i   with ld >= num_aos */
+typedef enum {
+    BALBOA_AO_MAJOR,
+    BALBOA_POINT_MAJOR
+    } balboa_ao_order_t;
+
 BALBOA_API
 balboa_context_t *balboa_new_context();
 
@@ -31,25 +44,63 @@ int balboa_set_basis(balboa_context_t *balboa_context,
                      const double primitive_exponents[],
                      const double contraction_coefficients[]);
 
+/* a positive accuracy evaluates the contracted radial functions from
+   cubic splines tabulated at basis setup, to this accuracy relative to
+   the largest value of each radial function; 0 (default) sums the
+   primitives; splines are used for max_geo_order up to 2 */
+BALBOA_API
+int balboa_set_spline_accuracy(balboa_context_t *balboa_context,
+                               const double accuracy);
+
 BALBOA_API
 int balboa_get_num_aos(const balboa_context_t *balboa_context);
 
 BALBOA_API
 int balboa_get_ao_center(const balboa_context_t *balboa_context, const int i);
 
+BALBOA_API
+int balboa_get_num_shells(const balboa_context_t *balboa_context);
+
+/* index of the first AO of shell i, AOs of a shell are contiguous */
+BALBOA_API
+int balboa_get_shell_off(const balboa_context_t *balboa_context, const int i);
+
+/* spherical AOs of shell i in terms of its Cartesian AOs, a
+   (cartesian x spherical) matrix stored row-major in coefficients */
+BALBOA_API
+int balboa_get_spherical_transform(const balboa_context_t *balboa_context,
+                                   const int i,
+                                   double coefficients[]);
+
 BALBOA_API
 int balboa_get_geo_offset(const balboa_context_t *balboa_context,
                           const int i,
                           const int j,
                           const int k);
 
+/* length of the AO output of balboa_get_ao: one block of num_aos * num_points
+   per derivative slice, where num_aos counts spherical AOs for a spherical
+   basis */
 BALBOA_API
 int balboa_get_buffer_len(const balboa_context_t *balboa_context,
                           const int max_geo_order,
                           const int num_points);
 
+/* scratch memory for balboa_get_ao, sized for the basis of the context
+   and geometric derivatives up to max_geo_order; one workspace per
+   thread, reused for all calls until the basis changes */
+BALBOA_API
+balboa_workspace_t *balboa_new_workspace(
+    const balboa_context_t *balboa_context, const int max_geo_order);
+
+BALBOA_API
+void balboa_free_workspace(balboa_workspace_t *workspace);
+
+/* a NULL workspace allocates a temporary one for this call; returns -1
+   if the workspace is too small for the basis or max_geo_order */
 BALBOA_API
 int balboa_get_ao(const balboa_context_t *balboa_context,
+                  balboa_workspace_t *workspace,
                   const int max_geo_order,
                   const int num_points,
                   const double x_coordinates_bohr[],
@@ -57,6 +108,55 @@ int balboa_get_ao(const balboa_context_t *balboa_context,
                   const double z_coordinates_bohr[],
                   double buffer[]);
 
+/* balboa_get_ao where only the shells on the num_derv_centers centers
+   in derv_centers (counting from 0) get all slices up to max_geo_order;
+   shells on the other centers get the slices up to base_geo_order and
+   their higher slices are zero, e.g. for geometric derivatives where
+   only AOs on the differentiated centers contribute */
+BALBOA_API
+int balboa_get_ao_on_centers(const balboa_context_t *balboa_context,
+                             balboa_workspace_t *workspace,
+                             const int max_geo_order,
+                             const int base_geo_order,
+                             const int num_derv_centers,
+                             const int derv_centers[],
+                             const int num_points,
+                             const double x_coordinates_bohr[],
+                             const double y_coordinates_bohr[],
+                             const double z_coordinates_bohr[],
+                             double buffer[]);
+
+/* smallest leading dimension for this order which is a multiple of 8,
+   so that with a 64-byte aligned buffer every row starts on a cache
+   line */
+BALBOA_API
+int balboa_get_aligned_leading_dim(const balboa_context_t *balboa_context,
+                                   const balboa_ao_order_t order,
+                                   const int num_points);
+
+/* length of the AO output of balboa_get_ao_layout */
+BALBOA_API
+int balboa_get_layout_buffer_len(const balboa_context_t *balboa_context,
+                                 const balboa_ao_order_t order,
+                                 const int leading_dim,
+                                 const int max_geo_order,
+                                 const int num_points);
+
+/* balboa_get_ao with the AOs in the given order and leading dimension;
+   balboa_get_ao is BALBOA_AO_MAJOR with leading_dim = num_points;
+   padding elements are zeroed; returns -1 if leading_dim is too small */
+BALBOA_API
+int balboa_get_ao_layout(const balboa_context_t *balboa_context,
+                         balboa_workspace_t *workspace,
+                         const balboa_ao_order_t order,
+                         const int leading_dim,
+                         const int max_geo_order,
+                         const int num_points,
+                         const double x_coordinates_bohr[],
+                         const double y_coordinates_bohr[],
+                         const double z_coordinates_bohr[],
+                         double buffer[]);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,141 @@
+#include <math.h>
+#include <vector>
+
+#include "balboa_parameters.h"
+#include "cs_trans.h"
+
+// see: http://blog.plover.com/math/choose.html
+static double binom(const int n, const int k)
+{
+    if (k == 0)
+        return 1.0;
+    if (n == 0)
+        return 0.0;
+    double m = n;
+    double b = 1.0;
+    for (int j = 0; j < k; j++)
+    {
+        b = b * m;
+        b = b / (j + 1);
+        m -= 1.0;
+    }
+    return b;
+}
+
+// double to prevent overflow
+static double fac(const int n)
+{
+    double r = 1.0;
+    for (int i = 0; i < n; i++)
+        r *= (double)(i + 1);
+    return r;
+}
+
+// double to prevent overflow, only used for n > 0
+static double fac2(const int n)
+{
+    double r = (double)n;
+    for (int i = n - 2; i > 0; i -= 2)
+        r *= (double)i;
+    return r;
+}
+
+struct cs_trans_table
+{
+    std::vector<int> offset;
+    std::vector<double> coef;
+};
+
+// transformation of Cartesian to pure spherical harmonic Gaussians,
+// see IJQC 54, 83 (1995), per l a (cartesian x spherical) block
+static cs_trans_table get_cs_trans_table()
+{
+    cs_trans_table table;
+
+    for (int l = 0; l <= MAX_L_VALUE; l++)
+    {
+        int nc = (l + 1) * (l + 2) / 2;
+        int ns = 2 * l + 1;
+
+        table.offset.push_back(table.coef.size());
+
+        if (l < 2)
+        {
+            // identity, p functions are ordered x, y, z
+            for (int c = 0; c < nc; c++)
+                for (int s = 0; s < ns; s++)
+                    table.coef.push_back(c == s ? 1.0 : 0.0);
+            continue;
+        }
+
+        std::vector<double> legendre_coef(l + 1, 0.0);
+        std::vector<double> cossin_coef((l + 1) * (l + 1), 0.0);
+        // (spherical x cartesian)
+        std::vector<double> tmat(nc * ns, 0.0);
+
+        for (int k = 0; k <= l / 2; k++)
+        {
+            legendre_coef[l - 2 * k] = (pow(-1.0, k) / pow(2.0, l)) *
+                                       binom(l, k) * binom(2 * (l - k), l);
+        }
+
+        for (int m = 0; m <= l; m++)
+        {
+            cossin_coef[m] = 1.0;
+            for (int k = 1; k <= m; k++)
+            {
+                cossin_coef[k * (l + 1) + m] +=
+                    cossin_coef[(k - 1) * (l + 1) + m - 1] * pow(-1.0, k - 1);
+                if (m > k)
+                    cossin_coef[k * (l + 1) + m] +=
+                        cossin_coef[k * (l + 1) + m - 1];
+            }
+        }
+
+        for (int m = 0; m <= l; m++)
+        {
+            double cm = 1.0;
+            if (m > 0)
+                cm = sqrt(2.0 * fac(l - m) / fac(l + m));
+            cm = cm / sqrt(fac2(2 * l - 1));
+
+            for (int k = (l - m) % 2; k <= l - m; k += 2)
+            {
+                // derivative of the Legendre polynomial, in place
+                if (m > 0)
+                    legendre_coef[k] = (k + 1) * legendre_coef[k + 1];
+                double cmk = cm * legendre_coef[k];
+                for (int i = 0; i <= (l - k - m) / 2; i++)
+                {
+                    double cmki = cmk * binom((l - k - m) / 2, i);
+                    for (int j = 0; j <= i; j++)
+                    {
+                        double cmkij = cmki * binom(i, j);
+                        for (int n = 0; n <= m; n++)
+                        {
+                            int ix = l - 2 * j - m + n;
+                            ix = ix * (ix + 1) / 2 + l + 1 - m - 2 * i;
+                            int ilm = 1 + l + m;
+                            if (n % 2 == 1)
+                                ilm = 1 + l - m;
+                            tmat[(ilm - 1) * nc + ix - 1] +=
+                                cmkij * cossin_coef[n * (l + 1) + m];
+                        }
+                    }
+                }
+            }
+        }
+
+        for (int c = 0; c < nc; c++)
+            for (int s = 0; s < ns; s++)
+                table.coef.push_back(tmat[s * nc + c]);
+    }
+
+    return table;
+}
+
+const double *get_cs_trans(const int l)
+{
+    static const cs_trans_table table = get_cs_trans_table();
+    return &table.coef[table.offset[l]];
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// spherical AOs of shell type l in terms of the Cartesian AOs of the same
+// shell, a (cartesian x spherical) block, row-major; l <= MAX_L_VALUE
+const double *get_cs_trans(const int l);
@@ -1,6 +1,7 @@
 set(AO_CHUNK_LENGTH "32" CACHE STRING "AO chunk length")
 set(MAX_GEO_DIFF_ORDER "5" CACHE STRING "Maximum geometric differentiation order")
 set(MAX_L_VALUE "5" CACHE STRING "Maximum L value")
+set(EXP_ACCURACY "1.0e-14" CACHE STRING "Relative accuracy of the vectorized exponential")
 
 configure_file(
     ${PROJECT_SOURCE_DIR}/balboa/parameters.h.in
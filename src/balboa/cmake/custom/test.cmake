@@ -17,19 +17,38 @@ set_property(
             PYTHONPATH=${PROJECT_SOURCE_DIR}
     )
 
+# same test with the kernels built for the default target
 add_test(
     NAME
-        test_generate
+        test_main_generic
     COMMAND
-        py.test -vv -s ${PROJECT_SOURCE_DIR}/balboa/generate.py
+        py.test -vv -s ${PROJECT_SOURCE_DIR}/test/test.py
     )
 
 set_property(
     TEST
-        test_generate
+        test_main_generic
     PROPERTY
         ENVIRONMENT
             BALBOA_LIBRARY_DIR=${PROJECT_BINARY_DIR}/lib
             BALBOA_INCLUDE_DIR=${PROJECT_SOURCE_DIR}/balboa
             PYTHONPATH=${PROJECT_SOURCE_DIR}
+            BALBOA_ISA=generic
+    )
+
+add_executable(
+    test_exp
+    ${PROJECT_SOURCE_DIR}/test/test_exp.cpp
+    )
+
+target_link_libraries(
+    test_exp
+    balboa
+    )
+
+add_test(
+    NAME
+        test_exp
+    COMMAND
+        test_exp
     )
@@ -7,7 +7,10 @@ import random
 
 def sub(num_points,
         num_points_reference,
-        generate_reference=False):
+        generate_reference=False,
+        spline_accuracy=0.0,
+        point_major=False,
+        derv_centers=None):
 
     assert num_points <= num_points_reference
     max_geo_order = 2
@@ -98,6 +101,9 @@ def sub(num_points,
 
     context = balboa.new_context()
 
+    if spline_accuracy > 0.0:
+        ierr = balboa.set_spline_accuracy(context, spline_accuracy)
+
     ierr = balboa.set_basis(context,
                             0,
                             num_centers,
@@ -145,9 +151,23 @@ def sub(num_points,
             for line in f.readlines():
                 ref_aos.append(float(line))
 
-    # buffer length is adjusted for number of cartesian aos
-    # so possibly longer than the number of spherical aos
+    # one block of spherical aos per derivative slice
     _l = balboa.get_buffer_len(context, max_geo_order, num_points)
+    assert _l == num_slices * num_aos * num_points
+
+    # point-major rows padded to whole cache lines
+    leading_dim = num_points
+    if point_major:
+        leading_dim = balboa.get_aligned_leading_dim(context,
+                                                     balboa.POINT_MAJOR,
+                                                     num_points)
+        assert leading_dim == 24
+        _l = balboa.get_layout_buffer_len(context,
+                                          balboa.POINT_MAJOR,
+                                          leading_dim,
+                                          max_geo_order,
+                                          num_points)
+        assert _l == num_slices * num_points * leading_dim
 
     # allocate a numpy array of length l and zero it out
     aos = np.zeros(_l, dtype=np.float64)
@@ -159,13 +179,42 @@ def sub(num_points,
     ffi = FFI()
     aos_p = ffi.cast("double *", aos.ctypes.data)
 
-    ierr = balboa.get_ao(context,
-                         max_geo_order,
-                         num_points,
-                         x_coordinates_bohr,
-                         y_coordinates_bohr,
-                         z_coordinates_bohr,
-                         aos_p)
+    workspace = balboa.new_workspace(context, max_geo_order)
+
+    if point_major:
+        ierr = balboa.get_ao_layout(context,
+                                    workspace,
+                                    balboa.POINT_MAJOR,
+                                    leading_dim,
+                                    max_geo_order,
+                                    num_points,
+                                    x_coordinates_bohr,
+                                    y_coordinates_bohr,
+                                    z_coordinates_bohr,
+                                    aos_p)
+    elif derv_centers is not None:
+        # only the values for shells on the other centers
+        ierr = balboa.get_ao_on_centers(context,
+                                        workspace,
+                                        max_geo_order,
+                                        0,
+                                        len(derv_centers),
+                                        derv_centers,
+                                        num_points,
+                                        x_coordinates_bohr,
+                                        y_coordinates_bohr,
+                                        z_coordinates_bohr,
+                                        aos_p)
+    else:
+        ierr = balboa.get_ao(context,
+                             workspace,
+                             max_geo_order,
+                             num_points,
+                             x_coordinates_bohr,
+                             y_coordinates_bohr,
+                             z_coordinates_bohr,
+                             aos_p)
+    assert ierr == 0
 
     ao_centers = [balboa.get_ao_center(context, i) for i in range(num_aos)]
     assert ao_centers == [0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1]
@@ -193,14 +242,26 @@ def sub(num_points,
         for _diff in range(num_slices):
             for _ao in range(num_aos):
                 for _point in range(num_points):
+                    if point_major:
+                        k = (_diff * num_points + _point) * leading_dim + _ao
+                    if derv_centers is not None and _diff > 0 and \
+                            ao_centers[_ao] not in derv_centers:
+                        assert aos[k] == 0.0
+                        kr += 1
+                        k += 1
+                        continue
                     error = aos[k] - ref_aos[kr]
-                    if abs(ref_aos[kr]) > 1.0e-20:
+                    if spline_accuracy > 0.0:
+                        # splines are accurate relative to the largest value
+                        error /= max(abs(ref_aos[kr]), 1.0e-3)
+                    elif abs(ref_aos[kr]) > 1.0e-20:
                         error /= ref_aos[kr]
                     assert abs(error) < 1.0e-8
                     kr += 1
                     k += 1
                 kr += num_points_reference - num_points
 
+    balboa.free_workspace(workspace)
     balboa.free_context(context)
 
 
@@ -214,6 +275,31 @@ def test_33():
         num_points_reference=33)
 
 
+def test_spline():
+    sub(num_points=33,
+        num_points_reference=33,
+        spline_accuracy=1.0e-12)
+
+
+def test_spline_accuracy_not_reached():
+    # all shells fall back to summing the primitives
+    sub(num_points=33,
+        num_points_reference=33,
+        spline_accuracy=1.0e-300)
+
+
+def test_point_major():
+    sub(num_points=33,
+        num_points_reference=33,
+        point_major=True)
+
+
+def test_derv_centers():
+    sub(num_points=33,
+        num_points_reference=33,
+        derv_centers=[1])
+
+
 if __name__ == '__main__':
     sub(num_points=33,
         num_points_reference=33,
@@ -0,0 +1,91 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "ao_vector.h"
+#include "balboa_parameters.h"
+
+// compares the vectorized exponentials with libm for arguments close
+// to the underflow threshold (-708.39), close to zero, and in between,
+// for every length up to 20 so that all tails of the 4 and 8 point
+// loops are covered
+
+#define MAX_LENGTH 20
+
+static int check(const ao_isa_t isa, const char *name, const double x0)
+{
+    double p2[MAX_LENGTH];
+    double s[MAX_LENGTH];
+    int num_failed = 0;
+
+    for (int n = 1; n <= MAX_LENGTH; n++)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            p2[i] = x0 + 1.0e-3 * (i - n / 2);
+        }
+
+        bool is_nonzero = get_exp(isa, n, p2, 1.0, 1.0, s);
+
+        bool any_kept = false;
+        for (int i = 0; i < n; i++)
+        {
+            // below the threshold the result is exactly zero
+            double reference = (p2[i] < -708.39) ? 0.0 : exp(p2[i]);
+            if (reference > 0.0)
+                any_kept = true;
+            double error = fabs(s[i] - reference);
+            if (error > EXP_ACCURACY * reference)
+            {
+                fprintf(stderr,
+                        "%s: exp(%.17g) = %.17g, libm %.17g (n = %i)\n",
+                        name,
+                        p2[i],
+                        s[i],
+                        reference,
+                        n);
+                num_failed++;
+            }
+        }
+        if (is_nonzero != any_kept)
+        {
+            fprintf(stderr,
+                    "%s: wrong underflow flag at %.17g (n = %i)\n",
+                    name,
+                    x0,
+                    n);
+            num_failed++;
+        }
+    }
+
+    return num_failed;
+}
+
+int main()
+{
+    const double arguments[] = {-708.39, -708.4, -750.0, -0.0, -1.0e-9,
+                                1.0e-9, -0.3465, 0.3465, -25.3, -300.7};
+    const int num_arguments = sizeof(arguments) / sizeof(arguments[0]);
+
+    ao_isa_t isa = get_ao_isa();
+
+    int num_failed = 0;
+    int num_checked = 0;
+    for (int k = 0; k < num_arguments; k++)
+    {
+        if (isa == AO_ISA_AVX512)
+        {
+            num_failed += check(AO_ISA_AVX512, "avx512", arguments[k]);
+            num_checked++;
+        }
+        if (isa == AO_ISA_AVX512 or isa == AO_ISA_AVX2)
+        {
+            num_failed += check(AO_ISA_AVX2, "avx2", arguments[k]);
+            num_checked++;
+        }
+    }
+
+    if (num_checked == 0)
+        printf("no vectorized exponential on this CPU, nothing checked\n");
+
+    return (num_failed == 0) ? 0 : 1;
+}
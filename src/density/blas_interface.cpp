@@ -1,5 +1,9 @@
 #include "blas_interface.h"
 
+#ifdef HAVE_SMALL_GEMM
+#include "small_gemm.h"
+#endif
+
 void wrap_dgemm(char ta,
                 char tb,
                 int m,
@@ -14,6 +18,10 @@ void wrap_dgemm(char ta,
                 double *c,
                 int ldc)
 {
+#ifdef HAVE_SMALL_GEMM
+    if (small_dgemm(ta, tb, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc))
+        return;
+#endif
     dgemm_(&ta, &tb, &m, &n, &k, &alpha, a, &lda, b, &ldb, &beta, c, &ldc);
 }
 
@@ -30,5 +38,74 @@ void wrap_dsymm(char si,
                 double *c,
                 int ldc)
 {
+#ifdef HAVE_SMALL_GEMM
+    if (small_dsymm(si, up, m, n, alpha, a, lda, b, ldb, beta, c, ldc))
+        return;
+#endif
     dsymm_(&si, &up, &m, &n, &alpha, a, &lda, b, &ldb, &beta, c, &ldc);
 }
+
+void wrap_dsyr2k(char up,
+                 char tr,
+                 int n,
+                 int k,
+                 double alpha,
+                 const double *a,
+                 int lda,
+                 const double *b,
+                 int ldb,
+                 double beta,
+                 double *c,
+                 int ldc)
+{
+    dsyr2k_(&up, &tr, &n, &k, &alpha, a, &lda, b, &ldb, &beta, c, &ldc);
+}
+
+void wrap_sgemm(char ta,
+                char tb,
+                int m,
+                int n,
+                int k,
+                float alpha,
+                const float *a,
+                int lda,
+                const float *b,
+                int ldb,
+                float beta,
+                float *c,
+                int ldc)
+{
+    sgemm_(&ta, &tb, &m, &n, &k, &alpha, a, &lda, b, &ldb, &beta, c, &ldc);
+}
+
+void wrap_ssymm(char si,
+                char up,
+                int m,
+                int n,
+                float alpha,
+                const float *a,
+                int lda,
+                const float *b,
+                int ldb,
+                float beta,
+                float *c,
+                int ldc)
+{
+    ssymm_(&si, &up, &m, &n, &alpha, a, &lda, b, &ldb, &beta, c, &ldc);
+}
+
+void wrap_ssyr2k(char up,
+                 char tr,
+                 int n,
+                 int k,
+                 float alpha,
+                 const float *a,
+                 int lda,
+                 const float *b,
+                 int ldb,
+                 float beta,
+                 float *c,
+                 int ldc)
+{
+    ssyr2k_(&up, &tr, &n, &k, &alpha, a, &lda, b, &ldb, &beta, c, &ldc);
+}
@@ -27,6 +27,61 @@ void wrap_dsymm(char si,
                 double *c,
                 int ldc);
 
+void wrap_dsyr2k(char up,
+                 char tr,
+                 int n,
+                 int k,
+                 double alpha,
+                 const double *a,
+                 int lda,
+                 const double *b,
+                 int ldb,
+                 double beta,
+                 double *c,
+                 int ldc);
+
+// single-precision variants used by the mixed-precision path,
+// results are accumulated in double precision by the callers
+void wrap_sgemm(char ta,
+                char tb,
+                int m,
+                int n,
+                int k,
+                float alpha,
+                const float *a,
+                int lda,
+                const float *b,
+                int ldb,
+                float beta,
+                float *c,
+                int ldc);
+
+void wrap_ssymm(char si,
+                char up,
+                int m,
+                int n,
+                float alpha,
+                const float *a,
+                int lda,
+                const float *b,
+                int ldb,
+                float beta,
+                float *c,
+                int ldc);
+
+void wrap_ssyr2k(char up,
+                 char tr,
+                 int n,
+                 int k,
+                 float alpha,
+                 const float *a,
+                 int lda,
+                 const float *b,
+                 int ldb,
+                 float beta,
+                 float *c,
+                 int ldc);
+
 extern "C"
 {
     void dgemm_(const char *ta,
@@ -54,4 +109,53 @@ extern "C"
                 const double *beta,
                 const double *c,
                 int *ldc);
+    void dsyr2k_(const char *up,
+                 const char *tr,
+                 const int *n,
+                 const int *k,
+                 const double *alpha,
+                 const double *a,
+                 const int *lda,
+                 const double *b,
+                 const int *ldb,
+                 const double *beta,
+                 double *c,
+                 const int *ldc);
+    void sgemm_(const char *ta,
+                const char *tb,
+                const int *m,
+                const int *n,
+                const int *k,
+                const float *alpha,
+                const float *a,
+                const int *lda,
+                const float *b,
+                const int *ldb,
+                const float *beta,
+                float *c,
+                const int *ldc);
+    void ssymm_(const char *si,
+                const char *up,
+                const int *m,
+                const int *n,
+                const float *alpha,
+                const float *a,
+                const int *lda,
+                const float *b,
+                const int *ldb,
+                const float *beta,
+                const float *c,
+                int *ldc);
+    void ssyr2k_(const char *up,
+                 const char *tr,
+                 const int *n,
+                 const int *k,
+                 const float *alpha,
+                 const float *a,
+                 const int *lda,
+                 const float *b,
+                 const int *ldb,
+                 const float *beta,
+                 float *c,
+                 const int *ldc);
 };
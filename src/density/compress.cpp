@@ -1,10 +1,11 @@
 #include "compress.h"
+#include "density_kernels.h"
 
 // size_t
 #include <cstddef>
 
-// abs
-#include <cmath>
+// copy
+#include <algorithm>
 
 bool is_same_center(const int c, const std::vector<int> &carray)
 {
@@ -22,9 +23,12 @@ void compress(const bool use_gradient,
               int &num_compressed_aos,
               int compressed_aos_indices[],
               double compressed_aos[],
+              float compressed_aos_single[],
               const int num_aos,
               const double aos[],
               const int ao_centers[],
+              const int num_shells,
+              const int shell_off[],
               const std::vector<int> &coor,
               const int slice_offsets[4])
 {
@@ -38,21 +42,42 @@ void compress(const bool use_gradient,
     (use_gradient) ? (num_slices = 4) : (num_slices = 1);
 
     int n = 0;
-    for (int i = 0; i < num_aos; i++)
+    if (shell_off != NULL)
     {
-        if (is_same_center(ao_centers[i], cent))
+        // we keep or drop whole shells so that the compressed
+        // AOs form runs of contiguous AO indices
+        for (int ishell = 0; ishell < num_shells; ishell++)
         {
-            double tmax = 0.0;
-            for (int ib = 0; ib < block_length; ib++)
+            int first = shell_off[ishell];
+            int last = num_aos;
+            if (ishell < num_shells - 1)
+                last = shell_off[ishell + 1];
+            if (!is_same_center(ao_centers[first], cent))
+                continue;
+            // the AOs of one shell are contiguous in aos
+            if (is_above((last - first) * block_length,
+                         &aos[first * block_length],
+                         1.0e-15))
             {
-                double t = std::abs(aos[i * block_length + ib]);
-                if (t > tmax)
-                    tmax = t;
+                for (int i = first; i < last; i++)
+                {
+                    compressed_aos_indices[n] = i;
+                    n++;
+                }
             }
-            if (tmax > 1.0e-15)
+        }
+    }
+    else
+    {
+        for (int i = 0; i < num_aos; i++)
+        {
+            if (is_same_center(ao_centers[i], cent))
             {
-                compressed_aos_indices[n] = i;
-                n++;
+                if (is_above(block_length, &aos[i * block_length], 1.0e-15))
+                {
+                    compressed_aos_indices[n] = i;
+                    n++;
+                }
             }
         }
     }
@@ -61,17 +86,43 @@ void compress(const bool use_gradient,
     if (num_compressed_aos == 0)
         return;
 
+    // the slices of one AO follow each other so that all slices
+    // together form one wide operand with leading dimension
+    // num_slices*block_length
+    int ld = num_slices * block_length;
     for (int i = 0; i < num_compressed_aos; i++)
     {
         for (int islice = 0; islice < num_slices; islice++)
         {
             int iuoff = slice_offsets[islice];
-            int icoff = islice * num_aos;
 
             int iu = block_length * (iuoff + compressed_aos_indices[i]);
-            int ic = block_length * (icoff + i);
+            int ic = i * ld + islice * block_length;
 
             std::copy(&aos[iu], &aos[iu + block_length], &compressed_aos[ic]);
         }
     }
+
+    // single-precision copy for the mixed-precision path
+    if (compressed_aos_single != NULL)
+    {
+        copy_to_single(
+            num_compressed_aos * ld, compressed_aos, compressed_aos_single);
+    }
+}
+
+void get_runs(const int num_compressed_aos,
+              const int compressed_aos_indices[],
+              std::vector<int> &runs)
+{
+    runs.clear();
+    for (int i = 0; i < num_compressed_aos; i++)
+    {
+        if (i == 0 or
+            compressed_aos_indices[i] != compressed_aos_indices[i - 1] + 1)
+        {
+            runs.push_back(i);
+        }
+    }
+    runs.push_back(num_compressed_aos);
 }
@@ -2,13 +2,28 @@
 
 #include <vector>
 
+// if shell_off is not NULL whole shells are kept or dropped
+// so that the compressed AOs form runs of contiguous AO indices
+
+// compressed AO i, slice s (0: value, 1-3: gradient), point b
+// is found at compressed_aos[(i*num_slices + s)*block_length + b]
+
 void compress(const bool use_gradient,
               const int block_length,
               int &num_compressed_aos,
               int compressed_aos_indices[],
               double compressed_aos[],
+              float compressed_aos_single[],
               const int num_aos,
               const double aos[],
               const int ao_centers[],
+              const int num_shells,
+              const int shell_off[],
               const std::vector<int> &coor,
               const int slice_offsets[4]);
+
+// splits the compressed AOs into runs of contiguous AO indices,
+// run r covers compressed AOs runs[r] to runs[r + 1] - 1
+void get_runs(const int num_compressed_aos,
+              const int compressed_aos_indices[],
+              std::vector<int> &runs);
@@ -9,141 +9,506 @@
 
 #include "blas_interface.h"
 #include "compress.h"
+#include "density_kernels.h"
+
+// F(k, l) = W(k, b) AO_l(l, b)^T + beta F(k, l) where b runs over all
+// stacked slices of W, W has leading dimension ldw, AO_l leading
+// dimension lda, and F leading dimension ldf
+// if k and l match only the lower triangle of the symmetric part
+// 0.5 (W AO^T + AO W^T) is formed which is half the work
+// in single precision if W_single is not NULL
+static void form_fmat(const bool kl_match,
+                      const int k_aoc_num,
+                      const int l_aoc_num,
+                      const double l_aoc[],
+                      const float l_aoc_single[],
+                      const int lda,
+                      const double W[],
+                      float W_single[],
+                      const int ldw,
+                      const double beta,
+                      double F[],
+                      float F_single[],
+                      const int ldf)
+{
+    if (W_single != NULL)
+    {
+        copy_to_single(ldw * k_aoc_num, W, W_single);
+    }
+
+    if (kl_match)
+    {
+        // upper in fortran is lower in C
+        char up = 'u';
+        char tr = 't';
+        int in = k_aoc_num;
+        int ik = ldw;
+        int ldb = ldw;
+        if (W_single != NULL)
+        {
+            wrap_ssyr2k(up,
+                        tr,
+                        in,
+                        ik,
+                        0.5f,
+                        l_aoc_single,
+                        lda,
+                        W_single,
+                        ldb,
+                        (float)beta,
+                        F_single,
+                        ldf);
+        }
+        else
+        {
+            wrap_dsyr2k(
+                up, tr, in, ik, 0.5, l_aoc, lda, W, ldb, beta, F, ldf);
+        }
+    }
+    else
+    {
+        // we transpose W instead of AO_l because we call fortran blas
+        char ta = 't';
+        char tb = 'n';
+        int im = l_aoc_num;
+        int in = k_aoc_num;
+        int ik = ldw;
+        int ldb = ldw;
+        if (W_single != NULL)
+        {
+            wrap_sgemm(ta,
+                       tb,
+                       im,
+                       in,
+                       ik,
+                       1.0f,
+                       l_aoc_single,
+                       lda,
+                       W_single,
+                       ldb,
+                       (float)beta,
+                       F_single,
+                       ldf);
+        }
+        else
+        {
+            wrap_dgemm(
+                ta, tb, im, in, ik, 1.0, l_aoc, lda, W, ldb, beta, F, ldf);
+        }
+    }
+}
+
+// matrix element or zero if the layout does not store it
+static inline double get_element(const MatrixLayout &layout,
+                                 const double mat[],
+                                 const int k,
+                                 const int l)
+{
+    int i = layout.get_offset(k, l);
+    return (i < 0) ? 0.0 : mat[i];
+}
+
+// mat(kc, lc) += F(k, l) for all compressed k and l, only l <= k
+// if lower_only, whole runs of contiguous l AOs are added in one go
+// where the layout stores them contiguously
+static void scatter_rows(const MatrixLayout &layout,
+                         const bool lower_only,
+                         const int k_aoc_num,
+                         const int k_aoc_index[],
+                         const int l_aoc_num,
+                         const int l_aoc_index[],
+                         const std::vector<int> &l_runs,
+                         const double F[],
+                         double mat[])
+{
+    for (int k = 0; k < k_aoc_num; k++)
+    {
+        int kc = k_aoc_index[k];
+        for (size_t r = 0; r + 1 < l_runs.size(); r++)
+        {
+            int l0 = l_runs[r];
+            int l1 = l_runs[r + 1];
+            if (lower_only)
+            {
+                if (l0 > k)
+                    break;
+                l1 = std::min(l1, k + 1);
+            }
+            int n = l1 - l0;
+            int lc = l_aoc_index[l0];
+            const double *f = &F[k * l_aoc_num + l0];
+            if (layout.is_contiguous(kc, lc, n))
+            {
+                double *m = &mat[layout.get_offset(kc, lc)];
+                for (int j = 0; j < n; j++)
+                {
+                    m[j] += f[j];
+                }
+            }
+            else
+            {
+                for (int j = 0; j < n; j++)
+                {
+                    int i = layout.get_offset(kc, lc + j);
+                    if (i > -1)
+                        mat[i] += f[j];
+                }
+            }
+        }
+    }
+}
 
 void distribute_matrix(const int mat_dim,
+                       const MatrixLayout &layout,
                        const int block_length,
                        const bool use_gradient,
                        const bool use_tau,
                        const double prefactors[],
                        const double u[],
                        double fmat[],
+                       const bool kl_match,
                        const int k_aoc_num,
                        const int k_aoc_index[],
                        const double k_aoc[],
                        const int l_aoc_num,
                        const int l_aoc_index[],
-                       const double l_aoc[])
+                       const double l_aoc[],
+                       const float l_aoc_single[])
 {
     // here we compute       F(k, l) += AO_k(k, b) u(b) AO_l(l, b)
     // in two steps
     // step 1:               W(k, b)  = AO_k(k, b) u(b)
     // step 2:               F(k, l) += W(k, b) AO_l(l, b)^T
+    //
+    // for tau the gradient slices of W are stacked behind the first one
+    // step 1:               W(k, s, b) = 0.5 u_tau(b) AO_k(k, s, b)
+    // so that step 2 sums over s and b in one matrix multiplication
 
     if (k_aoc_num == 0)
         return;
     if (l_aoc_num == 0)
         return;
 
-    double *W = new double[k_aoc_num * block_length];
-
-    std::fill(&W[0], &W[block_length * k_aoc_num], 0.0);
+    bool use_single = (l_aoc_single != NULL);
 
-    int kc, lc, iboff;
+    std::vector<int> k_runs;
+    std::vector<int> l_runs;
+    get_runs(k_aoc_num, k_aoc_index, k_runs);
+    get_runs(l_aoc_num, l_aoc_index, l_runs);
 
     int num_slices;
     (use_gradient) ? (num_slices = 4) : (num_slices = 1);
+    int ld = num_slices * block_length;
+
+    bool tau_is_used = (use_tau and std::abs(prefactors[4]) > 0.0);
+    int num_w_slices;
+    (tau_is_used) ? (num_w_slices = 4) : (num_w_slices = 1);
+    int ldw = num_w_slices * block_length;
+
+    double *W = new double[k_aoc_num * ldw];
+
+    std::fill(&W[0], &W[k_aoc_num * ldw], 0.0);
+
+    float *W_single = NULL;
+    float *F_single = NULL;
+    if (use_single)
+    {
+        W_single = new float[k_aoc_num * ldw];
+        F_single = new float[k_aoc_num * l_aoc_num];
+        std::fill(&F_single[0], &F_single[k_aoc_num * l_aoc_num], 0.0f);
+    }
+
+    int kc, lc;
+
+    form_wmat(block_length,
+              k_aoc_num,
+              num_slices,
+              tau_is_used,
+              prefactors,
+              u,
+              k_aoc,
+              ld,
+              W,
+              ldw);
+
+    // if k and l are one run each and the matrix is dense we can
+    // accumulate directly into the submatrix of fmat, this is only
+    // worth it (and correct) for the general case since the
+    // symmetric case has to be added to both triangles
+    if (!kl_match and !use_single and layout.is_dense() and
+        k_runs.size() == 2 and l_runs.size() == 2)
+    {
+        form_fmat(kl_match,
+                  k_aoc_num,
+                  l_aoc_num,
+                  l_aoc,
+                  l_aoc_single,
+                  ld,
+                  W,
+                  W_single,
+                  ldw,
+                  1.0,
+                  &fmat[k_aoc_index[0] * mat_dim + l_aoc_index[0]],
+                  F_single,
+                  mat_dim);
+        delete[] W;
+        W = NULL;
+        return;
+    }
+
+    double *F = new double[k_aoc_num * l_aoc_num];
+
+    // we compute F(k, l) = W(k, b) AO_l(l, b)^T
+    form_fmat(kl_match,
+              k_aoc_num,
+              l_aoc_num,
+              l_aoc,
+              l_aoc_single,
+              ld,
+              W,
+              W_single,
+              ldw,
+              0.0,
+              F,
+              F_single,
+              l_aoc_num);
+
+    delete[] W;
+    W = NULL;
+
+    if (use_single)
+    {
+        std::copy(&F_single[0], &F_single[k_aoc_num * l_aoc_num], &F[0]);
+        delete[] W_single;
+        W_single = NULL;
+        delete[] F_single;
+        F_single = NULL;
+    }
 
-    for (int islice = 0; islice < num_slices; islice++)
+    if (kl_match)
     {
-        if (std::abs(prefactors[islice]) > 0.0)
+        // F is symmetric and only its lower triangle is there,
+        // we add it to both triangles so that no symmetrization
+        // is needed later, for packed storage both are the same
+        scatter_rows(layout,
+                     true,
+                     k_aoc_num,
+                     k_aoc_index,
+                     l_aoc_num,
+                     l_aoc_index,
+                     l_runs,
+                     F,
+                     fmat);
+        for (int k = 0; k < k_aoc_num; k++)
         {
-            for (int k = 0; k < k_aoc_num; k++)
+            kc = k_aoc_index[k];
+            for (int l = 0; l < k; l++)
             {
-                iboff = k * block_length;
-                for (int ib = 0; ib < block_length; ib++)
-                {
-                    W[iboff + ib] +=
-                        prefactors[islice] * u[islice * block_length + ib] *
-                        k_aoc[islice * block_length * mat_dim + iboff + ib];
-                }
+                lc = l_aoc_index[l];
+                int j = layout.get_offset(lc, kc);
+                if (j > -1 and j != layout.get_offset(kc, lc))
+                    fmat[j] += F[k * l_aoc_num + l];
             }
         }
     }
+    else if (layout.is_packed())
+    {
+        // packed storage receives (k, l) and (l, k) in one element
+        // so we add half of each which gives the symmetrized matrix
+        for (int k = 0; k < k_aoc_num; k++)
+        {
+            kc = k_aoc_index[k];
+            for (int l = 0; l < l_aoc_num; l++)
+            {
+                lc = l_aoc_index[l];
+                int i = layout.get_offset(kc, lc);
+                if (kc != lc)
+                    fmat[i] += 0.5 * F[k * l_aoc_num + l];
+                else
+                    fmat[i] += F[k * l_aoc_num + l];
+            }
+        }
+    }
+    else
+    {
+        scatter_rows(layout,
+                     false,
+                     k_aoc_num,
+                     k_aoc_index,
+                     l_aoc_num,
+                     l_aoc_index,
+                     l_runs,
+                     F,
+                     fmat);
+    }
 
-    double *F = new double[k_aoc_num * l_aoc_num];
-
-    // we compute F(k, l) += W(k, b) AO_l(l, b)^T
-    // we transpose W instead of AO_l because we call fortran blas
-    char ta = 't';
-    char tb = 'n';
-    int im = l_aoc_num;
-    int in = k_aoc_num;
-    int ik = block_length;
-    int lda = ik;
-    int ldb = ik;
-    int ldc = im;
-    double alpha = 1.0;
-    double beta = 0.0;
-    wrap_dgemm(ta,
-               tb,
-               im,
-               in,
-               ik,
-               alpha,
-               l_aoc,
-               lda,
-               W,
-               ldb,
-               beta,
-               F,
-               ldc);
+    delete[] F;
+    F = NULL;
+}
 
-    if (use_tau)
+// D(k, l) = mat(kc, lc) for all compressed k and l, only l <= k
+// if lower_only, whole runs of contiguous l AOs are copied in one go
+// where the layout stores them contiguously
+static void gather_rows(const MatrixLayout &layout,
+                        const bool lower_only,
+                        const int k_aoc_num,
+                        const int k_aoc_index[],
+                        const int l_aoc_num,
+                        const int l_aoc_index[],
+                        const std::vector<int> &l_runs,
+                        const double mat[],
+                        double D[])
+{
+    for (int k = 0; k < k_aoc_num; k++)
     {
-        if (std::abs(prefactors[4]) > 0.0)
+        int kc = k_aoc_index[k];
+        for (size_t r = 0; r + 1 < l_runs.size(); r++)
         {
-            for (int ixyz = 0; ixyz < 3; ixyz++)
+            int l0 = l_runs[r];
+            int l1 = l_runs[r + 1];
+            if (lower_only)
+            {
+                if (l0 > k)
+                    break;
+                l1 = std::min(l1, k + 1);
+            }
+            int n = l1 - l0;
+            int lc = l_aoc_index[l0];
+            double *d = &D[k * l_aoc_num + l0];
+            if (layout.is_contiguous(kc, lc, n))
+            {
+                int i = layout.get_offset(kc, lc);
+                std::copy(&mat[i], &mat[i + n], d);
+            }
+            else
             {
-                for (int k = 0; k < k_aoc_num; k++)
+                for (int j = 0; j < n; j++)
                 {
-                    iboff = k * block_length;
-                    for (int ib = 0; ib < block_length; ib++)
-                    {
-                        W[iboff + ib] =
-                            u[4 * block_length + ib] *
-                            k_aoc[(ixyz + 1) * block_length * mat_dim + iboff +
-                                  ib];
-                    }
+                    d[j] = get_element(layout, mat, kc, lc + j);
                 }
-
-                alpha = prefactors[4];
-                beta = 1.0;
-                wrap_dgemm(ta,
-                           tb,
-                           im,
-                           in,
-                           ik,
-                           alpha,
-                           W,
-                           lda,
-                           &l_aoc[(ixyz + 1) * block_length * mat_dim],
-                           ldb,
-                           beta,
-                           F,
-                           ldc);
             }
         }
     }
+}
 
-    delete[] W;
-    W = NULL;
-
-    // FIXME easier route possible if k and l match
-    for (int k = 0; k < k_aoc_num; k++)
+// D(k, l) += mat(lc, kc) for all compressed k and l,
+// reading runs of contiguous k AOs in one go where possible
+static void gather_rows_transposed_add(const MatrixLayout &layout,
+                                       const int k_aoc_index[],
+                                       const std::vector<int> &k_runs,
+                                       const int l_aoc_num,
+                                       const int l_aoc_index[],
+                                       const double mat[],
+                                       double D[])
+{
+    for (int l = 0; l < l_aoc_num; l++)
     {
-        kc = k_aoc_index[k];
-        for (int l = 0; l < l_aoc_num; l++)
+        int lc = l_aoc_index[l];
+        for (size_t r = 0; r + 1 < k_runs.size(); r++)
         {
-            lc = l_aoc_index[l];
-            fmat[kc * mat_dim + lc] += F[k * l_aoc_num + l];
+            int k0 = k_runs[r];
+            int n = k_runs[r + 1] - k0;
+            int kc = k_aoc_index[k0];
+            if (layout.is_contiguous(lc, kc, n))
+            {
+                const double *m = &mat[layout.get_offset(lc, kc)];
+                for (int j = 0; j < n; j++)
+                {
+                    D[(k0 + j) * l_aoc_num + l] += m[j];
+                }
+            }
+            else
+            {
+                for (int j = 0; j < n; j++)
+                {
+                    D[(k0 + j) * l_aoc_num + l] +=
+                        get_element(layout, mat, lc, kc + j);
+                }
+            }
         }
     }
+}
 
-    delete[] F;
-    F = NULL;
+// X(k, b) = alpha D(k, l) AO_l(l, b) where b runs over m stacked points,
+// D has leading dimension ldd, AO_l leading dimension lda,
+// and X leading dimension m
+// in single precision if D_single is not NULL
+static void form_xmat(const bool dmat_is_symmetric,
+                      const int m,
+                      const int k_aoc_num,
+                      const int l_aoc_num,
+                      const double alpha,
+                      const double D[],
+                      const float D_single[],
+                      const int ldd,
+                      const double l_aoc[],
+                      const float l_aoc_single[],
+                      const int lda,
+                      double X[],
+                      float X_single[])
+{
+    if (dmat_is_symmetric)
+    {
+        char si = 'r';
+        char up = 'u';
+        int im = m;
+        int in = k_aoc_num;
+        int ldc = im;
+        if (D_single != NULL)
+        {
+            wrap_ssymm(si,
+                       up,
+                       im,
+                       in,
+                       (float)alpha,
+                       D_single,
+                       ldd,
+                       l_aoc_single,
+                       lda,
+                       0.0f,
+                       X_single,
+                       ldc);
+        }
+        else
+        {
+            wrap_dsymm(
+                si, up, im, in, alpha, D, ldd, l_aoc, lda, 0.0, X, ldc);
+        }
+    }
+    else
+    {
+        char ta = 'n';
+        char tb = 'n';
+        int im = m;
+        int in = k_aoc_num;
+        int ik = l_aoc_num;
+        int ldc = im;
+        if (D_single != NULL)
+        {
+            wrap_sgemm(ta,
+                       tb,
+                       im,
+                       in,
+                       ik,
+                       (float)alpha,
+                       l_aoc_single,
+                       lda,
+                       D_single,
+                       ldd,
+                       0.0f,
+                       X_single,
+                       ldc);
+        }
+        else
+        {
+            wrap_dgemm(
+                ta, tb, im, in, ik, alpha, l_aoc, lda, D, ldd, 0.0, X, ldc);
+        }
+    }
 }
 
 void get_density(const int mat_dim,
+                 const MatrixLayout &layout,
                  const int block_length,
                  const bool use_gradient,
                  const bool use_tau,
@@ -157,226 +522,782 @@ void get_density(const int mat_dim,
                  const double k_aoc[],
                  const int l_aoc_num,
                  const int l_aoc_index[],
-                 const double l_aoc[])
+                 const double l_aoc[],
+                 const float l_aoc_single[])
 {
     // here we compute       n(b)    = AO_k(k, b) D(k, l) AO_l(l, b)
     // in two steps
     // step 1:               X(k, b) = D(k, l) AO_l(l, b)
     // step 2:               n(b)    = AO_k(k, b) X(k, b)
+    //
+    // for tau step 1 runs over the value and gradient slices
+    // stacked into one wide operand so that one matrix
+    // multiplication gives everything that step 2 needs
 
     if (k_aoc_num == 0)
         return;
     if (l_aoc_num == 0)
         return;
 
-    int kc, lc, iboff;
+    bool use_single = (l_aoc_single != NULL);
+
+    int num_slices;
+    (use_gradient) ? (num_slices = 4) : (num_slices = 1);
+    int ld = num_slices * block_length;
+
+    bool tau_is_used = (use_tau and std::abs(prefactors[4]) > 0.0);
+    int num_x_slices;
+    (tau_is_used) ? (num_x_slices = 4) : (num_x_slices = 1);
+    int ldx = num_x_slices * block_length;
+
+    std::vector<int> k_runs;
+    std::vector<int> l_runs;
+    get_runs(k_aoc_num, k_aoc_index, k_runs);
+    get_runs(l_aoc_num, l_aoc_index, l_runs);
+
+    // D = 2 dmat unless dmat is not symmetric and k and l differ
+    // in which case D = dmat + dmat^T, the factor goes into alpha
+    bool use_transpose = (!kl_match and !dmat_is_symmetric);
+    double alpha = 2.0;
+    if (use_transpose)
+        alpha = 1.0;
+
+    // only the referenced triangle is needed in the symmetric case
+    bool lower_only = (kl_match and dmat_is_symmetric);
+
+    // if k and l are one run each and the matrix is dense we use
+    // the submatrix of dmat directly without copying it
+    bool use_submatrix = (!use_transpose and !use_single and
+                          layout.is_dense() and k_runs.size() == 2 and
+                          l_runs.size() == 2);
 
-    double *D = new double[k_aoc_num * l_aoc_num];
-    double *X = new double[k_aoc_num * block_length];
+    double *D = NULL;
+    double *X = new double[k_aoc_num * ldx];
+    const double *D_used = NULL;
+    int ldd = l_aoc_num;
+
+    float *D_single = NULL;
+    float *X_single = NULL;
+    if (use_single)
+    {
+        D_single = new float[k_aoc_num * l_aoc_num];
+        X_single = new float[k_aoc_num * ldx];
+    }
 
     // compress dmat
-    if (kl_match)
+    if (use_submatrix)
+    {
+        D_used = &dmat[k_aoc_index[0] * mat_dim + l_aoc_index[0]];
+        ldd = mat_dim;
+    }
+    else
     {
-        if (dmat_is_symmetric)
+        D = new double[k_aoc_num * l_aoc_num];
+        gather_rows(layout,
+                    lower_only,
+                    k_aoc_num,
+                    k_aoc_index,
+                    l_aoc_num,
+                    l_aoc_index,
+                    l_runs,
+                    dmat,
+                    D);
+        if (use_transpose)
         {
-            for (int k = 0; k < k_aoc_num; k++)
+            gather_rows_transposed_add(layout,
+                                       k_aoc_index,
+                                       k_runs,
+                                       l_aoc_num,
+                                       l_aoc_index,
+                                       dmat,
+                                       D);
+        }
+        D_used = D;
+    }
+
+    if (use_single)
+    {
+        for (int k = 0; k < k_aoc_num; k++)
+        {
+            int lmax = lower_only ? k + 1 : l_aoc_num;
+            for (int l = 0; l < lmax; l++)
             {
-                kc = k_aoc_index[k];
-                for (int l = 0; l <= k; l++)
-                {
-                    lc = l_aoc_index[l];
-                    D[k * l_aoc_num + l] = 2.0 * dmat[kc * mat_dim + lc];
-                }
+                D_single[k * l_aoc_num + l] = (float)D[k * l_aoc_num + l];
             }
         }
-        else
+    }
+
+    // form xmat, for tau over all stacked slices at once
+    form_xmat(dmat_is_symmetric,
+              ldx,
+              k_aoc_num,
+              l_aoc_num,
+              alpha,
+              D_used,
+              D_single,
+              ldd,
+              l_aoc,
+              l_aoc_single,
+              ld,
+              X,
+              X_single);
+
+//  it is not ok to zero out here since geometric
+//  derivatives are accumulated from several contributions
+//  std::fill(&density[0], &density[num_slices * block_length], 0.0);
+
+    // assemble density, possibly gradient, and possibly tau
+    if (use_single)
+    {
+        contract_xmat(block_length,
+                      k_aoc_num,
+                      num_slices,
+                      tau_is_used,
+                      prefactors,
+                      X_single,
+                      ldx,
+                      k_aoc,
+                      ld,
+                      density);
+    }
+    else
+    {
+        contract_xmat(block_length,
+                      k_aoc_num,
+                      num_slices,
+                      tau_is_used,
+                      prefactors,
+                      X,
+                      ldx,
+                      k_aoc,
+                      ld,
+                      density);
+    }
+
+    delete[] D;
+    D = NULL;
+    delete[] X;
+    X = NULL;
+    delete[] D_single;
+    D_single = NULL;
+    delete[] X_single;
+    X_single = NULL;
+}
+
+// D(k, l) = symmetric part of dmat(kc, lc) with both triangles, and
+// X(k, b) = D(k, l) AO(l, b) over the ld stacked points of aoc
+static void form_symmetric_xmat(const MatrixLayout &layout,
+                                const bool dmat_is_symmetric,
+                                const int ld,
+                                const int aoc_num,
+                                const int aoc_index[],
+                                const std::vector<int> &runs,
+                                const double dmat[],
+                                const double aoc[],
+                                double D[],
+                                double X[])
+{
+    gather_rows(layout,
+                false,
+                aoc_num,
+                aoc_index,
+                aoc_num,
+                aoc_index,
+                runs,
+                dmat,
+                D);
+    if (!dmat_is_symmetric)
+    {
+        for (int k = 0; k < aoc_num; k++)
         {
-            for (int k = 0; k < k_aoc_num; k++)
+            for (int l = 0; l < k; l++)
             {
-                kc = k_aoc_index[k];
-                for (int l = 0; l < l_aoc_num; l++)
-                {
-                    lc = l_aoc_index[l];
-                    D[k * l_aoc_num + l] = 2.0 * dmat[kc * mat_dim + lc];
-                }
+                double s = 0.5 * (D[k * aoc_num + l] + D[l * aoc_num + k]);
+                D[k * aoc_num + l] = s;
+                D[l * aoc_num + k] = s;
             }
         }
     }
-    else
+    form_xmat(true,
+              ld,
+              aoc_num,
+              aoc_num,
+              1.0,
+              D,
+              NULL,
+              aoc_num,
+              aoc,
+              NULL,
+              ld,
+              X,
+              NULL);
+}
+
+// for one AO with x = X(k, :), W = u0 X0 + sum_i ui Xi multiplies its
+// first and V_i = ui X0 + u_tau Xi / 2 its second geometric derivative
+static void form_wv(const int block_length,
+                    const bool use_gradient,
+                    const bool use_tau,
+                    const double u[],
+                    const double x[],
+                    double W[],
+                    double V[])
+{
+    for (int ib = 0; ib < block_length; ib++)
     {
-        if (dmat_is_symmetric)
+        W[ib] = u[ib] * x[ib];
+    }
+    if (!use_gradient)
+        return;
+    for (int i = 1; i < 4; i++)
+    {
+        const double *ui = &u[i * block_length];
+        const double *xi = &x[i * block_length];
+        double *v = &V[(i - 1) * block_length];
+        for (int ib = 0; ib < block_length; ib++)
+        {
+            W[ib] += ui[ib] * xi[ib];
+            v[ib] = ui[ib] * x[ib];
+        }
+        if (use_tau)
         {
-            for (int k = 0; k < k_aoc_num; k++)
+            const double *ut = &u[4 * block_length];
+            for (int ib = 0; ib < block_length; ib++)
             {
-                kc = k_aoc_index[k];
-                for (int l = 0; l < l_aoc_num; l++)
-                {
-                    lc = l_aoc_index[l];
-                    D[k * l_aoc_num + l] = 2.0 * dmat[kc * mat_dim + lc];
-                }
+                v[ib] += 0.5 * ut[ib] * xi[ib];
             }
         }
-        else
+    }
+}
+
+// out = K s for the stacked value and gradient slices s of one AO,
+// K = [[2 u0, 2 ui], [2 ui, u_tau]] is the form with which n, n_i,
+// and tau contract two AO products with u
+static void apply_kmat(const int block_length,
+                       const bool use_gradient,
+                       const bool use_tau,
+                       const double u[],
+                       const double s[],
+                       double out[])
+{
+    for (int ib = 0; ib < block_length; ib++)
+    {
+        out[ib] = 2.0 * u[ib] * s[ib];
+    }
+    if (!use_gradient)
+        return;
+    for (int i = 1; i < 4; i++)
+    {
+        const double *ui = &u[i * block_length];
+        const double *si = &s[i * block_length];
+        double *oi = &out[i * block_length];
+        for (int ib = 0; ib < block_length; ib++)
+        {
+            out[ib] += 2.0 * ui[ib] * si[ib];
+            oi[ib] = 2.0 * ui[ib] * s[ib];
+        }
+        if (use_tau)
         {
-            for (int k = 0; k < k_aoc_num; k++)
+            const double *ut = &u[4 * block_length];
+            for (int ib = 0; ib < block_length; ib++)
             {
-                kc = k_aoc_index[k];
-                for (int l = 0; l < l_aoc_num; l++)
-                {
-                    lc = l_aoc_index[l];
-                    D[k * l_aoc_num + l] =
-                        dmat[kc * mat_dim + lc] + dmat[lc * mat_dim + kc];
-                }
+                oi[ib] += ut[ib] * si[ib];
             }
         }
     }
+}
 
-    // form xmat
-    if (dmat_is_symmetric)
+static double dot(const int n, const double a[], const double b[])
+{
+    double s = 0.0;
+    for (int i = 0; i < n; i++)
     {
-        char si = 'r';
-        char up = 'u';
-        int im = block_length;
-        int in = k_aoc_num;
-        int lda = in;
-        int ldb = im;
-        int ldc = im;
-        double alpha = 1.0;
-        double beta = 0.0;
-        wrap_dsymm(
-            si, up, im, in, alpha, D, lda, l_aoc, ldb, beta, X, ldc);
+        s += a[i] * b[i];
     }
-    else
+    return s;
+}
+
+void add_geo_gradient(const MatrixLayout &layout,
+                      const int block_length,
+                      const bool use_gradient,
+                      const bool use_tau,
+                      const double u[],
+                      const double dmat[],
+                      const bool dmat_is_symmetric,
+                      const int aoc_num,
+                      const int aoc_index[],
+                      const double aoc[],
+                      const double ao[],
+                      const int ao_centers[],
+                      const bool center_is_used[],
+                      std::function<int(int, int, int)> get_geo_offset,
+                      double gradient[])
+{
+    // moving center A by R_a moves its AOs by -d_a, so with
+    // X = D [AO, AO_x, AO_y, AO_z] for the symmetric part of D
+    //
+    //   dn/dR_a   = -4 sum_{k on A} d_a AO_k X0_k
+    //   dn_i/dR_a = -4 sum_{k on A} d_a d_i AO_k X0_k + d_a AO_k Xi_k
+    //   dtau/dR_a = -2 sum_{k on A} sum_i d_a d_i AO_k Xi_k
+    //
+    // contracted with u over the points of the block
+
+    if (aoc_num == 0)
+        return;
+
+    int num_slices;
+    (use_gradient) ? (num_slices = 4) : (num_slices = 1);
+    int ld = num_slices * block_length;
+
+    std::vector<int> runs;
+    get_runs(aoc_num, aoc_index, runs);
+
+    double *D = new double[aoc_num * aoc_num];
+    double *X = new double[aoc_num * ld];
+    form_symmetric_xmat(layout,
+                        dmat_is_symmetric,
+                        ld,
+                        aoc_num,
+                        aoc_index,
+                        runs,
+                        dmat,
+                        aoc,
+                        D,
+                        X);
+
+    // offsets of the first and second derivative slices
+    int d1[3];
+    int d2[3][3];
+    for (int a = 0; a < 3; a++)
     {
-        char ta = 'n';
-        char tb = 'n';
-        int im = block_length;
-        int in = k_aoc_num;
-        int ik = l_aoc_num;
-        int lda = im;
-        int ldb = ik;
-        int ldc = im;
-        double alpha = 1.0;
-        double beta = 0.0;
-        wrap_dgemm(ta,
-                   tb,
-                   im,
-                   in,
-                   ik,
-                   alpha,
-                   l_aoc,
-                   lda,
-                   D,
-                   ldb,
-                   beta,
-                   X,
-                   ldc);
+        int ka[3] = {0, 0, 0};
+        ka[a]++;
+        d1[a] = get_geo_offset(ka[0], ka[1], ka[2]);
+        for (int i = 0; use_gradient and i < 3; i++)
+        {
+            int kai[3] = {ka[0], ka[1], ka[2]};
+            kai[i]++;
+            d2[a][i] = get_geo_offset(kai[0], kai[1], kai[2]);
+        }
+    }
+
+    double *W = new double[block_length];
+    double *V = new double[3 * block_length];
+
+    for (int k = 0; k < aoc_num; k++)
+    {
+        int kc = aoc_index[k];
+        int c = ao_centers[kc];
+        if (!center_is_used[c])
+            continue;
+
+        form_wv(block_length, use_gradient, use_tau, u, &X[k * ld], W, V);
+
+        for (int a = 0; a < 3; a++)
+        {
+            double s = dot(block_length, &ao[(d1[a] + kc) * block_length], W);
+            for (int i = 0; use_gradient and i < 3; i++)
+            {
+                s += dot(block_length,
+                         &ao[(d2[a][i] + kc) * block_length],
+                         &V[i * block_length]);
+            }
+            gradient[3 * c + a] -= 4.0 * s;
+        }
     }
 
+    delete[] D;
+    D = NULL;
+    delete[] X;
+    X = NULL;
+    delete[] W;
+    W = NULL;
+    delete[] V;
+    V = NULL;
+}
+
+void add_geo_hessian(const MatrixLayout &layout,
+                     const int block_length,
+                     const bool use_gradient,
+                     const bool use_tau,
+                     const double u[],
+                     const double f2[],
+                     const double dmat[],
+                     const bool dmat_is_symmetric,
+                     const int num_rmat,
+                     const double rmat[],
+                     const int aoc_num,
+                     const int aoc_index[],
+                     const double aoc[],
+                     const double ao[],
+                     const int ao_centers[],
+                     const int num_centers,
+                     const bool center_is_used[],
+                     std::function<int(int, int, int)> get_geo_offset,
+                     double hessian[],
+                     double response[])
+{
+    // with L^a_k = d_a [AO_k, AO_k,x, AO_k,y, AO_k,z] for AOs k on the
+    // center of coordinate a (zero otherwise), v^a the first derivatives
+    // of the variables (see add_geo_gradient), and K the form of
+    // apply_kmat, the second derivative at fixed dmat is
+    //
+    //   sum_b v^a f2 v^b                         (functional)
+    // + 2 sum_{k on A, l on B} D_kl L^a_k K L^b_l  (one AO each)
+    // + 4 d_AB sum_{k on A} d_a d_b AO_k W_k + d_a d_b d_i AO_k V_ik
+    //                                          (both on one AO)
+    //
+    // and the response to a change of dmat is dG_a/dD_kl =
+    //   AO_k K(f2 v^a) AO_l - L^a_k K(u) AO_l - AO_k K(u) L^a_l
+
+    if (aoc_num == 0)
+        return;
+
     int num_slices;
     (use_gradient) ? (num_slices = 4) : (num_slices = 1);
+    int num_variables = 1;
+    if (use_gradient)
+        num_variables = 4;
+    if (use_tau)
+        num_variables = 5;
+    int ld = num_slices * block_length;
+    int num_coor = 3 * num_centers;
+    int mat_len = layout.get_length();
 
-//  it is not ok to zero out here since geometric
-//  derivatives are accumulated from several contributions
-//  std::fill(&density[0], &density[num_slices * block_length], 0.0);
+    std::vector<int> runs;
+    get_runs(aoc_num, aoc_index, runs);
+
+    double *D = new double[aoc_num * aoc_num];
+    double *X = new double[aoc_num * ld];
+    form_symmetric_xmat(layout,
+                        dmat_is_symmetric,
+                        ld,
+                        aoc_num,
+                        aoc_index,
+                        runs,
+                        dmat,
+                        aoc,
+                        D,
+                        X);
+
+    // compressed AOs of every center which takes part, in order
+    std::vector<int> centers;
+    std::vector<std::vector<int>> center_aos(num_centers);
+    for (int k = 0; k < aoc_num; k++)
+    {
+        int c = ao_centers[aoc_index[k]];
+        if (!center_is_used[c])
+            continue;
+        if (center_aos[c].empty())
+            centers.push_back(c);
+        center_aos[c].push_back(k);
+    }
+    if (centers.empty())
+    {
+        delete[] D;
+        delete[] X;
+        return;
+    }
+
+    // local coordinates q = 3 i + a for the i-th center in centers
+    int num_q = 3 * centers.size();
+    std::vector<int> q_off(num_q + 1, 0);
+    for (int q = 0; q < num_q; q++)
+    {
+        q_off[q + 1] = q_off[q] + center_aos[centers[q / 3]].size();
+    }
 
-    // assemble density and possibly gradient
-    for (int islice = 0; islice < num_slices; islice++)
+    // L^q and v^q for all local coordinates
+    double *L = new double[q_off[num_q] * ld];
+    double *v = new double[num_q * num_variables * block_length];
+    std::fill(&v[0], &v[num_q * num_variables * block_length], 0.0);
+    for (int q = 0; q < num_q; q++)
     {
-        if (std::abs(prefactors[islice]) > 0.0)
+        const std::vector<int> &aos = center_aos[centers[q / 3]];
+        int off[4];
+        compute_slice_offsets(
+            get_geo_offset, std::vector<int>(1, q % 3 + 1), off);
+        double *vq = &v[q * num_variables * block_length];
+        for (size_t j = 0; j < aos.size(); j++)
         {
-            for (int k = 0; k < k_aoc_num; k++)
+            int k = aos[j];
+            int kc = aoc_index[k];
+            double *lq = &L[(q_off[q] + j) * ld];
+            const double *x = &X[k * ld];
+            for (int s = 0; s < num_slices; s++)
             {
-                iboff = k * block_length;
+                std::copy(&ao[(off[s] + kc) * block_length],
+                          &ao[(off[s] + kc + 1) * block_length],
+                          &lq[s * block_length]);
+            }
+            for (int ib = 0; ib < block_length; ib++)
+            {
+                vq[ib] -= 4.0 * lq[ib] * x[ib];
+            }
+            for (int i = 1; i < num_slices; i++)
+            {
+                double *vi = &vq[i * block_length];
+                double *vt = &vq[4 * block_length];
+                const double *li = &lq[i * block_length];
+                const double *xi = &x[i * block_length];
                 for (int ib = 0; ib < block_length; ib++)
                 {
-                    density[islice * block_length + ib] +=
-                        prefactors[islice] * X[iboff + ib] *
-                        k_aoc[islice * block_length * mat_dim + iboff + ib];
+                    vi[ib] -= 4.0 * (li[ib] * x[ib] + lq[ib] * xi[ib]);
+                }
+                if (use_tau)
+                {
+                    for (int ib = 0; ib < block_length; ib++)
+                    {
+                        vt[ib] -= 2.0 * li[ib] * xi[ib];
+                    }
                 }
             }
         }
     }
 
-    if (use_tau)
+    // t^q = f2 v^q
+    double *t = new double[num_q * num_variables * block_length];
+    std::fill(&t[0], &t[num_q * num_variables * block_length], 0.0);
+    for (int q = 0; q < num_q; q++)
     {
-        if (std::abs(prefactors[4]) > 0.0)
+        const double *vq = &v[q * num_variables * block_length];
+        double *tq = &t[q * num_variables * block_length];
+        for (int s = 0; s < num_variables; s++)
         {
-            for (int ixyz = 0; ixyz < 3; ixyz++)
+            for (int r = 0; r < num_variables; r++)
             {
-                if (dmat_is_symmetric)
+                const double *f = &f2[(s * num_variables + r) * block_length];
+                for (int ib = 0; ib < block_length; ib++)
                 {
-                    char si = 'r';
-                    char up = 'u';
-                    int im = block_length;
-                    int in = k_aoc_num;
-                    int lda = in;
-                    int ldb = im;
-                    int ldc = im;
-                    double alpha = 1.0;
-                    double beta = 0.0;
-                    wrap_dsymm(si,
-                               up,
-                               im,
-                               in,
-                               alpha,
-                               D,
-                               lda,
-                               &l_aoc[(ixyz + 1) * block_length * mat_dim],
-                               ldb,
-                               beta,
-                               X,
-                               ldc);
+                    tq[s * block_length + ib] +=
+                        f[ib] * vq[r * block_length + ib];
                 }
-                else
+            }
+        }
+    }
+
+    // functional term
+    for (int q = 0; q < num_q; q++)
+    {
+        int iq = 3 * centers[q / 3] + q % 3;
+        for (int r = 0; r < num_q; r++)
+        {
+            int ir = 3 * centers[r / 3] + r % 3;
+            hessian[iq * num_coor + ir] +=
+                dot(num_variables * block_length,
+                    &t[q * num_variables * block_length],
+                    &v[r * num_variables * block_length]);
+        }
+    }
+
+    // both derivatives on one AO
+    double *W = new double[block_length];
+    double *V = new double[3 * block_length];
+    for (size_t i = 0; i < centers.size(); i++)
+    {
+        int c = centers[i];
+        for (size_t j = 0; j < center_aos[c].size(); j++)
+        {
+            int k = center_aos[c][j];
+            int kc = aoc_index[k];
+            form_wv(block_length, use_gradient, use_tau, u, &X[k * ld], W, V);
+            for (int a = 0; a < 3; a++)
+            {
+                for (int b = 0; b < 3; b++)
                 {
-                    char ta = 'n';
-                    char tb = 'n';
-                    int im = block_length;
-                    int in = k_aoc_num;
-                    int ik = l_aoc_num;
-                    int lda = im;
-                    int ldb = ik;
-                    int ldc = im;
-                    double alpha = 1.0;
-                    double beta = 0.0;
-                    wrap_dgemm(ta,
-                               tb,
-                               im,
-                               in,
-                               ik,
-                               alpha,
-                               &l_aoc[(ixyz + 1) * block_length * mat_dim],
-                               lda,
-                               D,
-                               ldb,
-                               beta,
-                               X,
-                               ldc);
+                    int kab[3] = {0, 0, 0};
+                    kab[a]++;
+                    kab[b]++;
+                    double s = dot(block_length,
+                                   &ao[(get_geo_offset(kab[0], kab[1], kab[2]) +
+                                        kc) *
+                                       block_length],
+                                   W);
+                    for (int l = 0; use_gradient and l < 3; l++)
+                    {
+                        int kabl[3] = {kab[0], kab[1], kab[2]};
+                        kabl[l]++;
+                        s += dot(block_length,
+                                 &ao[(get_geo_offset(
+                                          kabl[0], kabl[1], kabl[2]) +
+                                      kc) *
+                                     block_length],
+                                 &V[l * block_length]);
+                    }
+                    hessian[(3 * c + a) * num_coor + 3 * c + b] += 4.0 * s;
                 }
+            }
+        }
+    }
+
+    // one derivative on each AO: Z^r = D(:, l on B) K(u) L^r_l
+    // contracted with L^q over the AOs on the center of q
+    int max_aos = 0;
+    for (size_t i = 0; i < centers.size(); i++)
+    {
+        max_aos = std::max(max_aos, (int)center_aos[centers[i]].size());
+    }
+    double *KL = new double[max_aos * ld];
+    double *Dcols = new double[aoc_num * max_aos];
+    double *Z = new double[aoc_num * ld];
+    for (int r = 0; r < num_q; r++)
+    {
+        const std::vector<int> &aos = center_aos[centers[r / 3]];
+        int n = aos.size();
+        int ir = 3 * centers[r / 3] + r % 3;
+        for (int j = 0; j < n; j++)
+        {
+            apply_kmat(block_length,
+                       use_gradient,
+                       use_tau,
+                       u,
+                       &L[(q_off[r] + j) * ld],
+                       &KL[j * ld]);
+        }
+        for (int k = 0; k < aoc_num; k++)
+        {
+            for (int j = 0; j < n; j++)
+            {
+                Dcols[k * n + j] = D[k * aoc_num + aos[j]];
+            }
+        }
+        form_xmat(false,
+                  ld,
+                  aoc_num,
+                  n,
+                  1.0,
+                  Dcols,
+                  NULL,
+                  n,
+                  KL,
+                  NULL,
+                  ld,
+                  Z,
+                  NULL);
+        for (int q = 0; q < num_q; q++)
+        {
+            const std::vector<int> &q_aos = center_aos[centers[q / 3]];
+            int iq = 3 * centers[q / 3] + q % 3;
+            double s = 0.0;
+            for (size_t j = 0; j < q_aos.size(); j++)
+            {
+                s += dot(ld, &L[(q_off[q] + j) * ld], &Z[q_aos[j] * ld]);
+            }
+            hessian[iq * num_coor + ir] += 2.0 * s;
+        }
+    }
 
-                for (int k = 0; k < k_aoc_num; k++)
+    // response: dG_q/dD contracted with every matrix R in rmat; with
+    // Y = sym(R) AO the first term of dG_q/dD gives t^q contracted with
+    // the density-like rho of R, and the two others 2 L^q_j K(u) Y_j,
+    // so no matrix over pairs of AOs is formed per coordinate
+    if (num_rmat > 0)
+    {
+        double *Y = new double[aoc_num * ld];
+        double *KY = new double[aoc_num * ld];
+        double *rho = new double[num_variables * block_length];
+        for (int m = 0; m < num_rmat; m++)
+        {
+            form_symmetric_xmat(layout,
+                                false,
+                                ld,
+                                aoc_num,
+                                aoc_index,
+                                runs,
+                                &rmat[m * mat_len],
+                                aoc,
+                                D,
+                                Y);
+
+            // sum_k AO_k K(t) Y_k = t rho for any t
+            std::fill(&rho[0], &rho[num_variables * block_length], 0.0);
+            for (int k = 0; k < aoc_num; k++)
+            {
+                const double *a = &aoc[k * ld];
+                const double *y = &Y[k * ld];
+                for (int ib = 0; ib < block_length; ib++)
                 {
-                    iboff = k * block_length;
+                    rho[ib] += 2.0 * a[ib] * y[ib];
+                }
+                for (int i = 1; i < num_slices; i++)
+                {
+                    const double *ai = &a[i * block_length];
+                    const double *yi = &y[i * block_length];
+                    double *ri = &rho[i * block_length];
+                    double *rt = &rho[4 * block_length];
                     for (int ib = 0; ib < block_length; ib++)
                     {
-                        density[4 * block_length + ib] +=
-                            prefactors[4] * X[iboff + ib] *
-                            k_aoc[(ixyz + 1) * block_length * mat_dim + iboff +
-                                  ib];
+                        ri[ib] += 2.0 * (ai[ib] * y[ib] + a[ib] * yi[ib]);
+                    }
+                    if (use_tau)
+                    {
+                        for (int ib = 0; ib < block_length; ib++)
+                        {
+                            rt[ib] += ai[ib] * yi[ib];
+                        }
                     }
                 }
             }
+
+            for (size_t i = 0; i < centers.size(); i++)
+            {
+                const std::vector<int> &aos = center_aos[centers[i]];
+                for (size_t j = 0; j < aos.size(); j++)
+                {
+                    apply_kmat(block_length,
+                               use_gradient,
+                               use_tau,
+                               u,
+                               &Y[aos[j] * ld],
+                               &KY[aos[j] * ld]);
+                }
+            }
+
+            for (int q = 0; q < num_q; q++)
+            {
+                const std::vector<int> &aos = center_aos[centers[q / 3]];
+                int iq = 3 * centers[q / 3] + q % 3;
+                double s = dot(num_variables * block_length,
+                               &t[q * num_variables * block_length],
+                               rho);
+                for (size_t j = 0; j < aos.size(); j++)
+                {
+                    s -= 2.0 * dot(ld,
+                                   &L[(q_off[q] + j) * ld],
+                                   &KY[aos[j] * ld]);
+                }
+                response[iq * num_rmat + m] += s;
+            }
         }
+        delete[] Y;
+        delete[] KY;
+        delete[] rho;
     }
 
     delete[] D;
     D = NULL;
     delete[] X;
     X = NULL;
+    delete[] L;
+    L = NULL;
+    delete[] v;
+    v = NULL;
+    delete[] t;
+    t = NULL;
+    delete[] W;
+    W = NULL;
+    delete[] V;
+    V = NULL;
+    delete[] KL;
+    KL = NULL;
+    delete[] Dcols;
+    Dcols = NULL;
+    delete[] Z;
+    Z = NULL;
 }
 
 void get_dens_geo_derv(const int mat_dim,
+                       const MatrixLayout &layout,
                        const int num_aos,
                        const int block_length,
                        const int buffer_len,
@@ -418,6 +1339,7 @@ void get_dens_geo_derv(const int mat_dim,
     case 1:
         k_coor.push_back(coor[0]);
         diff_u_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -438,6 +1360,7 @@ void get_dens_geo_derv(const int mat_dim,
         k_coor.push_back(coor[0]);
         k_coor.push_back(coor[1]);
         diff_u_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -456,6 +1379,7 @@ void get_dens_geo_derv(const int mat_dim,
         k_coor.push_back(coor[0]);
         l_coor.push_back(coor[1]);
         diff_u_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -477,6 +1401,7 @@ void get_dens_geo_derv(const int mat_dim,
         k_coor.push_back(coor[1]);
         k_coor.push_back(coor[2]);
         diff_u_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -496,6 +1421,7 @@ void get_dens_geo_derv(const int mat_dim,
         k_coor.push_back(coor[1]);
         l_coor.push_back(coor[2]);
         diff_u_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -515,6 +1441,7 @@ void get_dens_geo_derv(const int mat_dim,
         l_coor.push_back(coor[1]);
         l_coor.push_back(coor[2]);
         diff_u_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -534,6 +1461,7 @@ void get_dens_geo_derv(const int mat_dim,
         k_coor.push_back(coor[2]);
         l_coor.push_back(coor[1]);
         diff_u_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -556,6 +1484,7 @@ void get_dens_geo_derv(const int mat_dim,
         k_coor.push_back(coor[2]);
         k_coor.push_back(coor[3]);
         diff_u_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -576,6 +1505,7 @@ void get_dens_geo_derv(const int mat_dim,
         k_coor.push_back(coor[2]);
         l_coor.push_back(coor[3]);
         diff_u_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -596,6 +1526,7 @@ void get_dens_geo_derv(const int mat_dim,
         l_coor.push_back(coor[2]);
         l_coor.push_back(coor[3]);
         diff_u_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -616,6 +1547,7 @@ void get_dens_geo_derv(const int mat_dim,
         l_coor.push_back(coor[2]);
         l_coor.push_back(coor[3]);
         diff_u_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -636,6 +1568,7 @@ void get_dens_geo_derv(const int mat_dim,
         k_coor.push_back(coor[3]);
         l_coor.push_back(coor[2]);
         diff_u_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -656,6 +1589,7 @@ void get_dens_geo_derv(const int mat_dim,
         k_coor.push_back(coor[3]);
         l_coor.push_back(coor[1]);
         diff_u_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -676,6 +1610,7 @@ void get_dens_geo_derv(const int mat_dim,
         l_coor.push_back(coor[1]);
         l_coor.push_back(coor[3]);
         diff_u_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -696,6 +1631,7 @@ void get_dens_geo_derv(const int mat_dim,
         l_coor.push_back(coor[1]);
         l_coor.push_back(coor[2]);
         diff_u_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -720,6 +1656,7 @@ void get_dens_geo_derv(const int mat_dim,
 }
 
 void get_mat_geo_derv(const int mat_dim,
+                      const MatrixLayout &layout,
                       const int num_aos,
                       const int block_length,
                       const int buffer_len,
@@ -761,6 +1698,7 @@ void get_mat_geo_derv(const int mat_dim,
     case 1:
         k_coor.push_back(coor[0]);
         diff_M_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -781,6 +1719,7 @@ void get_mat_geo_derv(const int mat_dim,
         k_coor.push_back(coor[0]);
         k_coor.push_back(coor[1]);
         diff_M_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -799,6 +1738,7 @@ void get_mat_geo_derv(const int mat_dim,
         k_coor.push_back(coor[0]);
         l_coor.push_back(coor[1]);
         diff_M_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -820,6 +1760,7 @@ void get_mat_geo_derv(const int mat_dim,
         k_coor.push_back(coor[1]);
         k_coor.push_back(coor[2]);
         diff_M_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -839,6 +1780,7 @@ void get_mat_geo_derv(const int mat_dim,
         k_coor.push_back(coor[1]);
         l_coor.push_back(coor[2]);
         diff_M_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -858,6 +1800,7 @@ void get_mat_geo_derv(const int mat_dim,
         l_coor.push_back(coor[1]);
         l_coor.push_back(coor[2]);
         diff_M_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -877,6 +1820,7 @@ void get_mat_geo_derv(const int mat_dim,
         k_coor.push_back(coor[2]);
         l_coor.push_back(coor[1]);
         diff_M_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -899,6 +1843,7 @@ void get_mat_geo_derv(const int mat_dim,
         k_coor.push_back(coor[2]);
         k_coor.push_back(coor[3]);
         diff_M_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -919,6 +1864,7 @@ void get_mat_geo_derv(const int mat_dim,
         k_coor.push_back(coor[2]);
         l_coor.push_back(coor[3]);
         diff_M_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -939,6 +1885,7 @@ void get_mat_geo_derv(const int mat_dim,
         l_coor.push_back(coor[2]);
         l_coor.push_back(coor[3]);
         diff_M_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -959,6 +1906,7 @@ void get_mat_geo_derv(const int mat_dim,
         l_coor.push_back(coor[2]);
         l_coor.push_back(coor[3]);
         diff_M_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -979,6 +1927,7 @@ void get_mat_geo_derv(const int mat_dim,
         k_coor.push_back(coor[3]);
         l_coor.push_back(coor[2]);
         diff_M_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -999,6 +1948,7 @@ void get_mat_geo_derv(const int mat_dim,
         k_coor.push_back(coor[3]);
         l_coor.push_back(coor[1]);
         diff_M_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -1019,6 +1969,7 @@ void get_mat_geo_derv(const int mat_dim,
         l_coor.push_back(coor[1]);
         l_coor.push_back(coor[3]);
         diff_M_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -1039,6 +1990,7 @@ void get_mat_geo_derv(const int mat_dim,
         l_coor.push_back(coor[1]);
         l_coor.push_back(coor[2]);
         diff_M_wrt_center_tuple(mat_dim,
+                                layout,
                                 num_aos,
                                 block_length,
                                 buffer_len,
@@ -1063,6 +2015,7 @@ void get_mat_geo_derv(const int mat_dim,
 }
 
 void diff_u_wrt_center_tuple(const int mat_dim,
+                             const MatrixLayout &layout,
                              const int num_aos,
                              const int block_length,
                              const int buffer_len,
@@ -1090,9 +2043,12 @@ void diff_u_wrt_center_tuple(const int mat_dim,
              k_ao_compressed_num,
              k_ao_compressed_index,
              k_ao_compressed,
+             NULL,
              num_aos,
              ao,
              ao_centers,
+             0,
+             NULL,
              k_coor,
              slice_offsets);
     compute_slice_offsets(get_geo_offset, l_coor, slice_offsets);
@@ -1101,9 +2057,12 @@ void diff_u_wrt_center_tuple(const int mat_dim,
              l_ao_compressed_num,
              l_ao_compressed_index,
              l_ao_compressed,
+             NULL,
              num_aos,
              ao,
              ao_centers,
+             0,
+             NULL,
              l_coor,
              slice_offsets);
 
@@ -1111,6 +2070,7 @@ void diff_u_wrt_center_tuple(const int mat_dim,
 
     // evaluate density dervs
     get_density(mat_dim,
+                layout,
                 block_length,
                 use_gradient,
                 use_tau,
@@ -1124,11 +2084,13 @@ void diff_u_wrt_center_tuple(const int mat_dim,
                 k_ao_compressed,
                 l_ao_compressed_num,
                 l_ao_compressed_index,
-                l_ao_compressed);
+                l_ao_compressed,
+                NULL);
     if (use_gradient)
     {
         prefactors[0] = 0.0;
         get_density(mat_dim,
+                    layout,
                     block_length,
                     use_gradient,
                     false,
@@ -1142,7 +2104,8 @@ void diff_u_wrt_center_tuple(const int mat_dim,
                     l_ao_compressed,
                     k_ao_compressed_num,
                     k_ao_compressed_index,
-                    k_ao_compressed);
+                    k_ao_compressed,
+                    NULL);
     }
     delete[] k_ao_compressed;
     delete[] k_ao_compressed_index;
@@ -1151,6 +2114,7 @@ void diff_u_wrt_center_tuple(const int mat_dim,
 }
 
 void diff_M_wrt_center_tuple(const int mat_dim,
+                             const MatrixLayout &layout,
                              const int num_aos,
                              const int block_length,
                              const int buffer_len,
@@ -1178,9 +2142,12 @@ void diff_M_wrt_center_tuple(const int mat_dim,
              k_ao_compressed_num,
              k_ao_compressed_index,
              k_ao_compressed,
+             NULL,
              num_aos,
              ao,
              ao_centers,
+             0,
+             NULL,
              k_coor,
              slice_offsets);
     compute_slice_offsets(get_geo_offset, l_coor, slice_offsets);
@@ -1189,9 +2156,12 @@ void diff_M_wrt_center_tuple(const int mat_dim,
              l_ao_compressed_num,
              l_ao_compressed_index,
              l_ao_compressed,
+             NULL,
              num_aos,
              ao,
              ao_centers,
+             0,
+             NULL,
              l_coor,
              slice_offsets);
 
@@ -1199,34 +2169,40 @@ void diff_M_wrt_center_tuple(const int mat_dim,
 
     // distribute over XC potential derivative matrix
     distribute_matrix(mat_dim,
+                      layout,
                       block_length,
                       use_gradient,
                       use_tau,
                       prefactors,
                       u,
                       M,
+                      false,
                       k_ao_compressed_num,
                       k_ao_compressed_index,
                       k_ao_compressed,
                       l_ao_compressed_num,
                       l_ao_compressed_index,
-                      l_ao_compressed);
+                      l_ao_compressed,
+                      NULL);
     if (use_gradient)
     {
         prefactors[0] = 0.0;
         distribute_matrix(mat_dim,
+                          layout,
                           block_length,
                           use_gradient,
                           false,
                           prefactors,
                           u,
                           M,
+                          false,
                           l_ao_compressed_num,
                           l_ao_compressed_index,
                           l_ao_compressed,
                           k_ao_compressed_num,
                           k_ao_compressed_index,
-                          k_ao_compressed);
+                          k_ao_compressed,
+                          NULL);
     }
     delete[] k_ao_compressed;
     delete[] k_ao_compressed_index;
@@ -3,21 +3,38 @@
 #include <functional>
 #include <vector>
 
+#include "matrix_layout.h"
+
+// if l_aoc_single is not NULL, the matrix multiplications in
+// distribute_matrix and get_density are done in single precision
+// using l_aoc_single while n, u, and the matrix are accumulated
+// in double precision (see doc/interfacing.rst for error bounds)
+
+// dmat and fmat are stored as described by layout; elements which
+// the layout does not store are read as zero and not accumulated
+
+// if kl_match, distribute_matrix forms only the lower triangle of the
+// symmetric part and adds it to both triangles of fmat
+
 void distribute_matrix(const int mat_dim,
+                       const MatrixLayout &layout,
                        const int block_length,
                        const bool use_gradient,
                        const bool use_tau,
                        const double prefactors[],
                        const double u[],
                        double fmat[],
+                       const bool kl_match,
                        const int k_aoc_num,
                        const int k_aoc_index[],
                        const double k_aoc[],
                        const int l_aoc_num,
                        const int l_aoc_index[],
-                       const double l_aoc[]);
+                       const double l_aoc[],
+                       const float l_aoc_single[]);
 
 void get_density(const int mat_dim,
+                 const MatrixLayout &layout,
                  const int block_length,
                  const bool use_gradient,
                  const bool use_tau,
@@ -31,9 +48,58 @@ void get_density(const int mat_dim,
                  const double k_aoc[],
                  const int l_aoc_num,
                  const int l_aoc_index[],
-                 const double l_aoc[]);
+                 const double l_aoc[],
+                 const float l_aoc_single[]);
+
+// gradient[3 c + a] += dE/dR_ca for all centers c with center_is_used,
+// where u = w df/dvar of the block; aoc holds the value and gradient
+// slices of the AOs which pass the screening and ao the uncompressed
+// AOs with first (and for GGA second) geometric derivative slices
+void add_geo_gradient(const MatrixLayout &layout,
+                      const int block_length,
+                      const bool use_gradient,
+                      const bool use_tau,
+                      const double u[],
+                      const double dmat[],
+                      const bool dmat_is_symmetric,
+                      const int aoc_num,
+                      const int aoc_index[],
+                      const double aoc[],
+                      const double ao[],
+                      const int ao_centers[],
+                      const bool center_is_used[],
+                      std::function<int(int, int, int)> get_geo_offset,
+                      double gradient[]);
+
+// hessian[(3 c + a) * 3 num_centers + 3 d + b] += d2E/dR_ca dR_db at fixed
+// dmat for all centers c and d with center_is_used, where f2 holds
+// w d2f/dvar_s dvar_t of the block at f2[(s * num_variables + t) *
+// block_length]; with num_rmat > 0 also response[(3 c + a) * num_rmat + m]
+// += sum_kl d(dE/dR_ca)/dD_kl rmat_m(k, l) for the matrices in rmat;
+// ao needs geometric derivative slices up to order 2 (3 for GGA)
+void add_geo_hessian(const MatrixLayout &layout,
+                     const int block_length,
+                     const bool use_gradient,
+                     const bool use_tau,
+                     const double u[],
+                     const double f2[],
+                     const double dmat[],
+                     const bool dmat_is_symmetric,
+                     const int num_rmat,
+                     const double rmat[],
+                     const int aoc_num,
+                     const int aoc_index[],
+                     const double aoc[],
+                     const double ao[],
+                     const int ao_centers[],
+                     const int num_centers,
+                     const bool center_is_used[],
+                     std::function<int(int, int, int)> get_geo_offset,
+                     double hessian[],
+                     double response[]);
 
 void get_mat_geo_derv(const int mat_dim,
+                      const MatrixLayout &layout,
                       const int num_aos,
                       const int block_length,
                       const int buffer_len,
@@ -47,6 +113,7 @@ void get_mat_geo_derv(const int mat_dim,
                       double mat[]);
 
 void get_dens_geo_derv(const int mat_dim,
+                       const MatrixLayout &layout,
                        const int num_aos,
                        const int block_length,
                        const int buffer_len,
@@ -60,6 +127,7 @@ void get_dens_geo_derv(const int mat_dim,
                        const double mat[]);
 
 void diff_M_wrt_center_tuple(const int mat_dim,
+                             const MatrixLayout &layout,
                              const int num_aos,
                              const int block_length,
                              const int buffer_len,
@@ -75,6 +143,7 @@ void diff_M_wrt_center_tuple(const int mat_dim,
                              double M[]);
 
 void diff_u_wrt_center_tuple(const int mat_dim,
+                             const MatrixLayout &layout,
                              const int num_aos,
                              const int block_length,
                              const int buffer_len,
@@ -0,0 +1,116 @@
+// loops of density_kernels.h, included by density_kernels.cpp once per
+// instruction set inside its own namespace with DENSITY_KERNEL_TARGET
+// set to the matching target attribute; therefore no include guard and
+// no includes here
+
+DENSITY_KERNEL_TARGET void form_wmat(const int block_length,
+                                     const int k_aoc_num,
+                                     const int num_slices,
+                                     const bool tau_is_used,
+                                     const double prefactors[],
+                                     const double u[],
+                                     const double k_aoc[],
+                                     const int ld,
+                                     double W[],
+                                     const int ldw)
+{
+    for (int k = 0; k < k_aoc_num; k++)
+    {
+        double *__restrict__ w = &W[k * ldw];
+        const double *__restrict__ a = &k_aoc[k * ld];
+        for (int islice = 0; islice < num_slices; islice++)
+        {
+            if (std::abs(prefactors[islice]) > 0.0)
+            {
+                double f = prefactors[islice];
+                int ioff = islice * block_length;
+                const double *__restrict__ v = &u[ioff];
+                for (int ib = 0; ib < block_length; ib++)
+                {
+                    w[ib] += f * v[ib] * a[ioff + ib];
+                }
+            }
+        }
+        if (tau_is_used)
+        {
+            double f = prefactors[4];
+            const double *__restrict__ v = &u[4 * block_length];
+            for (int ixyz = 1; ixyz < 4; ixyz++)
+            {
+                int ioff = ixyz * block_length;
+                for (int ib = 0; ib < block_length; ib++)
+                {
+                    w[ioff + ib] = f * v[ib] * a[ioff + ib];
+                }
+            }
+        }
+    }
+}
+
+template <typename T>
+DENSITY_KERNEL_TARGET void contract_xmat(const int block_length,
+                                         const int k_aoc_num,
+                                         const int num_slices,
+                                         const bool tau_is_used,
+                                         const double prefactors[],
+                                         const T X[],
+                                         const int ldx,
+                                         const double k_aoc[],
+                                         const int ld,
+                                         double density[])
+{
+    for (int k = 0; k < k_aoc_num; k++)
+    {
+        const T *__restrict__ x = &X[k * ldx];
+        const double *__restrict__ a = &k_aoc[k * ld];
+        for (int islice = 0; islice < num_slices; islice++)
+        {
+            if (std::abs(prefactors[islice]) > 0.0)
+            {
+                double f = prefactors[islice];
+                int ioff = islice * block_length;
+                double *__restrict__ n = &density[ioff];
+                for (int ib = 0; ib < block_length; ib++)
+                {
+                    n[ib] += f * x[ib] * a[ioff + ib];
+                }
+            }
+        }
+        if (tau_is_used)
+        {
+            double f = prefactors[4];
+            double *__restrict__ n = &density[4 * block_length];
+            for (int ixyz = 1; ixyz < 4; ixyz++)
+            {
+                int ioff = ixyz * block_length;
+                for (int ib = 0; ib < block_length; ib++)
+                {
+                    n[ib] += f * x[ioff + ib] * a[ioff + ib];
+                }
+            }
+        }
+    }
+}
+
+DENSITY_KERNEL_TARGET bool is_above(const int n,
+                                    const double a[],
+                                    const double threshold)
+{
+    // no early exit so that the loop vectorizes
+    int above = 0;
+    for (int i = 0; i < n; i++)
+    {
+        above |= (std::abs(a[i]) > threshold);
+    }
+    return (above != 0);
+}
+
+DENSITY_KERNEL_TARGET void copy_to_single(const int n,
+                                          const double a[],
+                                          float r[])
+{
+    for (int i = 0; i < n; i++)
+    {
+        r[i] = (float)a[i];
+    }
+}
@@ -0,0 +1,161 @@
+#include "density_kernels.h"
+
+// abs
+#include <cmath>
+
+// getenv
+#include <cstdlib>
+
+// strcmp
+#include <cstring>
+
+// the same loops compiled for each instruction set, in namespaces of
+// their own so that the instantiations do not get mixed up at link time
+#define DENSITY_KERNEL_TARGET
+namespace density_generic
+{
+#include "density_kernel_templates.h"
+}
+#undef DENSITY_KERNEL_TARGET
+
+#if defined(__GNUC__) && defined(__x86_64__)
+
+#define DENSITY_KERNEL_TARGET __attribute__((target("avx2,fma")))
+namespace density_avx2
+{
+#include "density_kernel_templates.h"
+}
+#undef DENSITY_KERNEL_TARGET
+
+#define DENSITY_KERNEL_TARGET __attribute__((target("avx512f,avx2,fma")))
+namespace density_avx512
+{
+#include "density_kernel_templates.h"
+}
+#undef DENSITY_KERNEL_TARGET
+
+#endif
+
+static isa_t detect_isa()
+{
+    isa_t isa = ISA_NONE;
+#if defined(__GNUC__) && defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        isa = ISA_AVX512;
+    else if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma"))
+        isa = ISA_AVX2;
+#endif
+    const char *requested = std::getenv("XCINT_ISA");
+    if (requested != NULL)
+    {
+        if (std::strcmp(requested, "generic") == 0)
+            isa = ISA_NONE;
+        else if (std::strcmp(requested, "avx2") == 0 and isa == ISA_AVX512)
+            isa = ISA_AVX2;
+    }
+    return isa;
+}
+
+isa_t get_isa()
+{
+    static const isa_t isa = detect_isa();
+    return isa;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define DISPATCH(function, ...)                                                \
+    switch (get_isa())                                                         \
+    {                                                                          \
+    case ISA_AVX512:                                                           \
+        return density_avx512::function(__VA_ARGS__);                          \
+    case ISA_AVX2:                                                             \
+        return density_avx2::function(__VA_ARGS__);                            \
+    default:                                                                   \
+        return density_generic::function(__VA_ARGS__);                         \
+    }
+#else
+#define DISPATCH(function, ...) return density_generic::function(__VA_ARGS__);
+#endif
+
+void form_wmat(const int block_length,
+               const int k_aoc_num,
+               const int num_slices,
+               const bool tau_is_used,
+               const double prefactors[],
+               const double u[],
+               const double k_aoc[],
+               const int ld,
+               double W[],
+               const int ldw)
+{
+    DISPATCH(form_wmat,
+             block_length,
+             k_aoc_num,
+             num_slices,
+             tau_is_used,
+             prefactors,
+             u,
+             k_aoc,
+             ld,
+             W,
+             ldw)
+}
+
+void contract_xmat(const int block_length,
+                   const int k_aoc_num,
+                   const int num_slices,
+                   const bool tau_is_used,
+                   const double prefactors[],
+                   const double X[],
+                   const int ldx,
+                   const double k_aoc[],
+                   const int ld,
+                   double density[])
+{
+    DISPATCH(contract_xmat<double>,
+             block_length,
+             k_aoc_num,
+             num_slices,
+             tau_is_used,
+             prefactors,
+             X,
+             ldx,
+             k_aoc,
+             ld,
+             density)
+}
+
+void contract_xmat(const int block_length,
+                   const int k_aoc_num,
+                   const int num_slices,
+                   const bool tau_is_used,
+                   const double prefactors[],
+                   const float X[],
+                   const int ldx,
+                   const double k_aoc[],
+                   const int ld,
+                   double density[])
+{
+    DISPATCH(contract_xmat<float>,
+             block_length,
+             k_aoc_num,
+             num_slices,
+             tau_is_used,
+             prefactors,
+             X,
+             ldx,
+             k_aoc,
+             ld,
+             density)
+}
+
+bool is_above(const int n, const double a[], const double threshold)
+{
+    DISPATCH(is_above, n, a, threshold)
+}
+
+void copy_to_single(const int n, const double a[], float r[])
+{
+    DISPATCH(copy_to_single, n, a, r)
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// the vectorized loops of density.cpp and compress.cpp, built for each
+// instruction set below; the build for this CPU is chosen once per
+// process and used by all contexts
+
+// instruction sets for which the loops are built,
+// ISA_NONE is whatever the compiler targets by default
+enum isa_t
+{
+    ISA_NONE,
+    ISA_AVX2,
+    ISA_AVX512
+};
+
+// highest instruction set supported by this CPU, detected on first use;
+// the environment variable XCINT_ISA (generic or avx2) can lower it
+isa_t get_isa();
+
+// W(k, s, b) = AO_k(k, s, b) u(b) as in distribute_matrix: for slices
+// s < num_slices the products with u(s, b) are summed into slice 0,
+// with tau_is_used slices 1 to 3 are prefactors[4] u(4, b) AO_k(k, s, b)
+void form_wmat(const int block_length,
+               const int k_aoc_num,
+               const int num_slices,
+               const bool tau_is_used,
+               const double prefactors[],
+               const double u[],
+               const double k_aoc[],
+               const int ld,
+               double W[],
+               const int ldw);
+
+// one pass over all k which assembles density, gradient, and tau
+// n(s, b) += f(s) AO_k(k, s, b) X(k, 0, b)         s = 0..3
+// tau(b)  += f(4) AO_k(k, s, b) X(k, s, b)         s = 1..3
+// always accumulated in double precision
+void contract_xmat(const int block_length,
+                   const int k_aoc_num,
+                   const int num_slices,
+                   const bool tau_is_used,
+                   const double prefactors[],
+                   const double X[],
+                   const int ldx,
+                   const double k_aoc[],
+                   const int ld,
+                   double density[]);
+
+void contract_xmat(const int block_length,
+                   const int k_aoc_num,
+                   const int num_slices,
+                   const bool tau_is_used,
+                   const double prefactors[],
+                   const float X[],
+                   const int ldx,
+                   const double k_aoc[],
+                   const int ld,
+                   double density[]);
+
+// whether any of |a[0]| to |a[n - 1]| is larger than threshold
+bool is_above(const int n, const double a[], const double threshold);
+
+// r = a rounded to single precision
+void copy_to_single(const int n, const double a[], float r[]);
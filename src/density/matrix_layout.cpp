@@ -0,0 +1,190 @@
+#include "matrix_layout.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+MatrixLayout::MatrixLayout() { set_dense(0); }
+
+MatrixLayout::~MatrixLayout() {}
+
+void MatrixLayout::set_dense(const int in_mat_dim)
+{
+    type = LAYOUT_DENSE;
+    mat_dim = in_mat_dim;
+    length = mat_dim * mat_dim;
+    num_centers = 0;
+
+    ao_center.clear();
+    ao_local.clear();
+    ao_run_end.clear();
+    center_num_aos.clear();
+    block_offsets.clear();
+}
+
+void MatrixLayout::set_packed(const int in_mat_dim)
+{
+    set_dense(in_mat_dim);
+    type = LAYOUT_PACKED;
+    length = mat_dim * (mat_dim + 1) / 2;
+}
+
+// block_centers holds num_blocks pairs of (row center, column center),
+// counting from 1 like the shell centers passed to xcint_set_basis
+int MatrixLayout::set_block_sparse(const int in_mat_dim,
+                                   const int in_num_centers,
+                                   const int ao_centers[],
+                                   const int num_blocks,
+                                   const int block_centers[])
+{
+    std::vector<int> offsets(in_num_centers * in_num_centers, -1);
+    std::vector<int> num_aos(in_num_centers, 0);
+    std::vector<int> local(in_mat_dim, 0);
+
+    for (int i = 0; i < in_mat_dim; i++)
+    {
+        local[i] = num_aos[ao_centers[i]];
+        num_aos[ao_centers[i]]++;
+    }
+
+    // last AO of the run of AOs on the same center which i belongs to
+    std::vector<int> run_end(in_mat_dim, 0);
+    for (int i = in_mat_dim - 1; i >= 0; i--)
+    {
+        if (i < in_mat_dim - 1 and ao_centers[i + 1] == ao_centers[i])
+            run_end[i] = run_end[i + 1];
+        else
+            run_end[i] = i;
+    }
+
+    int n = 0;
+    for (int i = 0; i < num_blocks; i++)
+    {
+        int a = block_centers[2 * i] - 1;
+        int b = block_centers[2 * i + 1] - 1;
+        if (a < 0 or a >= in_num_centers or b < 0 or b >= in_num_centers)
+        {
+            fprintf(stderr, "ERROR: block center out of range.\n");
+            return -1;
+        }
+        if (offsets[a * in_num_centers + b] > -1)
+        {
+            fprintf(stderr, "ERROR: block listed twice.\n");
+            return -1;
+        }
+        offsets[a * in_num_centers + b] = n;
+        n += num_aos[a] * num_aos[b];
+    }
+
+    // the integrator scatters to (k, l) and (l, k) and symmetrizes
+    // at the end so the block pattern has to be symmetric
+    for (int a = 0; a < in_num_centers; a++)
+    {
+        for (int b = 0; b < a; b++)
+        {
+            if ((offsets[a * in_num_centers + b] < 0) !=
+                (offsets[b * in_num_centers + a] < 0))
+            {
+                fprintf(stderr, "ERROR: block pattern is not symmetric.\n");
+                return -1;
+            }
+        }
+    }
+
+    type = LAYOUT_BLOCK_SPARSE;
+    mat_dim = in_mat_dim;
+    length = n;
+    num_centers = in_num_centers;
+    ao_center.assign(&ao_centers[0], &ao_centers[in_mat_dim]);
+    ao_local = local;
+    ao_run_end = run_end;
+    center_num_aos = num_aos;
+    block_offsets = offsets;
+
+    return 0;
+}
+
+matrix_symmetry_t MatrixLayout::get_symmetry(const double mat[]) const
+{
+    // packed storage is symmetric by construction
+    if (type == LAYOUT_PACKED)
+        return MATRIX_SYMMETRIC;
+
+    double max_element = 0.0;
+    for (int i = 0; i < length; i++)
+        max_element = std::max(max_element, std::abs(mat[i]));
+    double threshold = 1.0e-12 * max_element;
+
+    bool is_symmetric = true;
+    bool is_antisymmetric = true;
+    for (int k = 0; k < mat_dim; k++)
+    {
+        for (int l = 0; l <= k; l++)
+        {
+            // the block pattern is symmetric so either both are stored
+            // or none
+            int kl = get_offset(k, l);
+            if (kl < 0)
+                continue;
+            int lk = get_offset(l, k);
+            if (std::abs(mat[kl] - mat[lk]) > threshold)
+                is_symmetric = false;
+            if (std::abs(mat[kl] + mat[lk]) > threshold)
+                is_antisymmetric = false;
+        }
+        if (!is_symmetric and !is_antisymmetric)
+            return MATRIX_GENERAL;
+    }
+
+    if (is_antisymmetric)
+        return MATRIX_ANTISYMMETRIC;
+    if (is_symmetric)
+        return MATRIX_SYMMETRIC;
+    return MATRIX_GENERAL;
+}
+
+void MatrixLayout::symmetrize(double mat[]) const
+{
+    // packed storage is symmetric by construction
+    if (type == LAYOUT_PACKED)
+        return;
+
+    if (type == LAYOUT_DENSE)
+    {
+        for (int k = 0; k < mat_dim; k++)
+        {
+            for (int l = 0; l < k; l++)
+            {
+                double a = mat[k * mat_dim + l] + mat[l * mat_dim + k];
+                mat[k * mat_dim + l] = 0.5 * a;
+                mat[l * mat_dim + k] = 0.5 * a;
+            }
+        }
+        return;
+    }
+
+    // block (a, b) against the transpose of block (b, a), a >= b
+    for (int a = 0; a < num_centers; a++)
+    {
+        for (int b = 0; b <= a; b++)
+        {
+            int ab = block_offsets[a * num_centers + b];
+            int ba = block_offsets[b * num_centers + a];
+            if (ab < 0)
+                continue;
+            int na = center_num_aos[a];
+            int nb = center_num_aos[b];
+            for (int i = 0; i < na; i++)
+            {
+                // diagonal blocks only need the strict lower triangle
+                int jmax = (a == b) ? i : nb;
+                for (int j = 0; j < jmax; j++)
+                {
+                    double s = mat[ab + i * nb + j] + mat[ba + j * na + i];
+                    mat[ab + i * nb + j] = 0.5 * s;
+                    mat[ba + j * na + i] = 0.5 * s;
+                }
+            }
+        }
+    }
+}
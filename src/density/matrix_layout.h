@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+
+// describes how AO matrices (dmat and vxc) are stored in memory
+//
+// dense:        mat_dim x mat_dim, element (k, l) at k*mat_dim + l
+// block-sparse: only the listed center-pair blocks are stored, one after
+//               the other in the given order, each block row-major
+//               with the AOs of the row center as rows
+// packed:       lower triangle row by row, element (k, l) with k >= l
+//               at k*(k + 1)/2 + l, only for symmetric matrices
+
+enum matrix_symmetry_t
+{
+    MATRIX_GENERAL,
+    MATRIX_SYMMETRIC,
+    MATRIX_ANTISYMMETRIC
+};
+
+class MatrixLayout
+{
+  public:
+    MatrixLayout();
+    ~MatrixLayout();
+
+    void set_dense(const int mat_dim);
+
+    void set_packed(const int mat_dim);
+
+    int set_block_sparse(const int mat_dim,
+                         const int num_centers,
+                         const int ao_centers[],
+                         const int num_blocks,
+                         const int block_centers[]);
+
+    bool is_dense() const { return type == LAYOUT_DENSE; }
+
+    bool is_packed() const { return type == LAYOUT_PACKED; }
+
+    // number of doubles one matrix occupies
+    int get_length() const { return length; }
+
+    // returns -1 if the element is not stored
+    int get_offset(const int k, const int l) const
+    {
+        if (type == LAYOUT_DENSE)
+            return k * mat_dim + l;
+        if (type == LAYOUT_PACKED)
+            return (k >= l) ? k * (k + 1) / 2 + l : l * (l + 1) / 2 + k;
+        int b = block_offsets[ao_center[k] * num_centers + ao_center[l]];
+        if (b < 0)
+            return -1;
+        return b + ao_local[k] * center_num_aos[ao_center[l]] + ao_local[l];
+    }
+
+    // true if elements (k, l) to (k, l + n - 1) are stored
+    // one after the other
+    bool is_contiguous(const int k, const int l, const int n) const
+    {
+        if (type == LAYOUT_DENSE)
+            return true;
+        if (type == LAYOUT_PACKED)
+            return (l + n - 1 <= k);
+        if (block_offsets[ao_center[k] * num_centers + ao_center[l]] < 0)
+            return false;
+        return (l + n - 1 <= ao_run_end[l]);
+    }
+
+    // symmetry of a matrix stored in this layout up to a small
+    // tolerance relative to its largest element, a zero matrix
+    // counts as antisymmetric
+    matrix_symmetry_t get_symmetry(const double mat[]) const;
+
+    // symmetrizes a matrix that was accumulated in this layout
+    void symmetrize(double mat[]) const;
+
+  private:
+    enum
+    {
+        LAYOUT_DENSE,
+        LAYOUT_BLOCK_SPARSE,
+        LAYOUT_PACKED
+    } type;
+
+    int mat_dim;
+    int length;
+    int num_centers;
+
+    std::vector<int> ao_center;
+    std::vector<int> ao_local;
+    std::vector<int> ao_run_end;
+    std::vector<int> center_num_aos;
+    std::vector<int> block_offsets;
+};
@@ -0,0 +1,725 @@
+#include "small_gemm.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+
+#include <immintrin.h>
+
+#include "blas_interface.h"
+#include "density_kernels.h"
+
+#define AVX2 __attribute__((target("avx2,fma")))
+#define AVX512 __attribute__((target("avx512f")))
+
+// shapes above this number of multiply-adds always go to BLAS
+#define SMALL_GEMM_MAX_WORK (1 << 24)
+
+// c = alpha acc + beta c, c is not read if beta is zero
+static inline double update(const double acc,
+                            const double alpha,
+                            const double beta,
+                            const double *c)
+{
+    if (beta == 0.0)
+        return alpha * acc;
+    return alpha * acc + beta * (*c);
+}
+
+AVX2 static inline void update_avx2(const __m256d acc,
+                                    const __m256d alpha,
+                                    const double beta,
+                                    double *c)
+{
+    __m256d r = _mm256_mul_pd(alpha, acc);
+    if (beta != 0.0)
+        r = _mm256_fmadd_pd(_mm256_set1_pd(beta), _mm256_loadu_pd(c), r);
+    _mm256_storeu_pd(c, r);
+}
+
+AVX2 static inline double hsum_avx2(const __m256d v)
+{
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+// C(m, n) = alpha A(m, k) B(k, n) + beta C(m, n)
+// 8 x 4 blocks of C are kept in registers, A is read along columns
+AVX2 static void dgemm_nn_avx2(const int m,
+                               const int n,
+                               const int k,
+                               const double alpha,
+                               const double *a,
+                               const int lda,
+                               const double *b,
+                               const int ldb,
+                               const double beta,
+                               double *c,
+                               const int ldc)
+{
+    const __m256d va = _mm256_set1_pd(alpha);
+
+    int i = 0;
+    for (; i + 8 <= m; i += 8)
+    {
+        int j = 0;
+        for (; j + 4 <= n; j += 4)
+        {
+            __m256d c00 = _mm256_setzero_pd();
+            __m256d c01 = _mm256_setzero_pd();
+            __m256d c10 = _mm256_setzero_pd();
+            __m256d c11 = _mm256_setzero_pd();
+            __m256d c20 = _mm256_setzero_pd();
+            __m256d c21 = _mm256_setzero_pd();
+            __m256d c30 = _mm256_setzero_pd();
+            __m256d c31 = _mm256_setzero_pd();
+            const double *b0 = &b[j * ldb];
+            for (int p = 0; p < k; p++)
+            {
+                __m256d a0 = _mm256_loadu_pd(&a[i + p * lda]);
+                __m256d a1 = _mm256_loadu_pd(&a[i + 4 + p * lda]);
+                __m256d bb = _mm256_broadcast_sd(&b0[p]);
+                c00 = _mm256_fmadd_pd(a0, bb, c00);
+                c01 = _mm256_fmadd_pd(a1, bb, c01);
+                bb = _mm256_broadcast_sd(&b0[p + ldb]);
+                c10 = _mm256_fmadd_pd(a0, bb, c10);
+                c11 = _mm256_fmadd_pd(a1, bb, c11);
+                bb = _mm256_broadcast_sd(&b0[p + 2 * ldb]);
+                c20 = _mm256_fmadd_pd(a0, bb, c20);
+                c21 = _mm256_fmadd_pd(a1, bb, c21);
+                bb = _mm256_broadcast_sd(&b0[p + 3 * ldb]);
+                c30 = _mm256_fmadd_pd(a0, bb, c30);
+                c31 = _mm256_fmadd_pd(a1, bb, c31);
+            }
+            update_avx2(c00, va, beta, &c[i + j * ldc]);
+            update_avx2(c01, va, beta, &c[i + 4 + j * ldc]);
+            update_avx2(c10, va, beta, &c[i + (j + 1) * ldc]);
+            update_avx2(c11, va, beta, &c[i + 4 + (j + 1) * ldc]);
+            update_avx2(c20, va, beta, &c[i + (j + 2) * ldc]);
+            update_avx2(c21, va, beta, &c[i + 4 + (j + 2) * ldc]);
+            update_avx2(c30, va, beta, &c[i + (j + 3) * ldc]);
+            update_avx2(c31, va, beta, &c[i + 4 + (j + 3) * ldc]);
+        }
+        for (; j < n; j++)
+        {
+            __m256d c00 = _mm256_setzero_pd();
+            __m256d c01 = _mm256_setzero_pd();
+            for (int p = 0; p < k; p++)
+            {
+                __m256d bb = _mm256_broadcast_sd(&b[p + j * ldb]);
+                c00 = _mm256_fmadd_pd(
+                    _mm256_loadu_pd(&a[i + p * lda]), bb, c00);
+                c01 = _mm256_fmadd_pd(
+                    _mm256_loadu_pd(&a[i + 4 + p * lda]), bb, c01);
+            }
+            update_avx2(c00, va, beta, &c[i + j * ldc]);
+            update_avx2(c01, va, beta, &c[i + 4 + j * ldc]);
+        }
+    }
+
+    // remaining rows
+    for (; i < m; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            double acc = 0.0;
+            for (int p = 0; p < k; p++)
+                acc += a[i + p * lda] * b[p + j * ldb];
+            c[i + j * ldc] = update(acc, alpha, beta, &c[i + j * ldc]);
+        }
+    }
+}
+
+// C(m, n) = alpha A(k, m)^T B(k, n) + beta C(m, n)
+// every element is a dot product along the contiguous k dimension,
+// 4 x 2 blocks of C share the loads
+AVX2 static void dgemm_tn_avx2(const int m,
+                               const int n,
+                               const int k,
+                               const double alpha,
+                               const double *a,
+                               const int lda,
+                               const double *b,
+                               const int ldb,
+                               const double beta,
+                               double *c,
+                               const int ldc)
+{
+    const int k4 = k - k % 4;
+
+    int j = 0;
+    for (; j + 2 <= n; j += 2)
+    {
+        const double *b0 = &b[j * ldb];
+        const double *b1 = &b[(j + 1) * ldb];
+        int i = 0;
+        for (; i + 4 <= m; i += 4)
+        {
+            const double *a0 = &a[i * lda];
+            const double *a1 = &a[(i + 1) * lda];
+            const double *a2 = &a[(i + 2) * lda];
+            const double *a3 = &a[(i + 3) * lda];
+            __m256d s00 = _mm256_setzero_pd();
+            __m256d s10 = _mm256_setzero_pd();
+            __m256d s20 = _mm256_setzero_pd();
+            __m256d s30 = _mm256_setzero_pd();
+            __m256d s01 = _mm256_setzero_pd();
+            __m256d s11 = _mm256_setzero_pd();
+            __m256d s21 = _mm256_setzero_pd();
+            __m256d s31 = _mm256_setzero_pd();
+            for (int p = 0; p < k4; p += 4)
+            {
+                __m256d vb0 = _mm256_loadu_pd(&b0[p]);
+                __m256d vb1 = _mm256_loadu_pd(&b1[p]);
+                __m256d va = _mm256_loadu_pd(&a0[p]);
+                s00 = _mm256_fmadd_pd(va, vb0, s00);
+                s01 = _mm256_fmadd_pd(va, vb1, s01);
+                va = _mm256_loadu_pd(&a1[p]);
+                s10 = _mm256_fmadd_pd(va, vb0, s10);
+                s11 = _mm256_fmadd_pd(va, vb1, s11);
+                va = _mm256_loadu_pd(&a2[p]);
+                s20 = _mm256_fmadd_pd(va, vb0, s20);
+                s21 = _mm256_fmadd_pd(va, vb1, s21);
+                va = _mm256_loadu_pd(&a3[p]);
+                s30 = _mm256_fmadd_pd(va, vb0, s30);
+                s31 = _mm256_fmadd_pd(va, vb1, s31);
+            }
+            double r[8] = {hsum_avx2(s00),
+                           hsum_avx2(s10),
+                           hsum_avx2(s20),
+                           hsum_avx2(s30),
+                           hsum_avx2(s01),
+                           hsum_avx2(s11),
+                           hsum_avx2(s21),
+                           hsum_avx2(s31)};
+            for (int p = k4; p < k; p++)
+            {
+                r[0] += a0[p] * b0[p];
+                r[1] += a1[p] * b0[p];
+                r[2] += a2[p] * b0[p];
+                r[3] += a3[p] * b0[p];
+                r[4] += a0[p] * b1[p];
+                r[5] += a1[p] * b1[p];
+                r[6] += a2[p] * b1[p];
+                r[7] += a3[p] * b1[p];
+            }
+            for (int ii = 0; ii < 4; ii++)
+            {
+                double *c0 = &c[i + ii + j * ldc];
+                double *c1 = &c[i + ii + (j + 1) * ldc];
+                *c0 = update(r[ii], alpha, beta, c0);
+                *c1 = update(r[4 + ii], alpha, beta, c1);
+            }
+        }
+        for (; i < m; i++)
+        {
+            const double *a0 = &a[i * lda];
+            __m256d s0 = _mm256_setzero_pd();
+            __m256d s1 = _mm256_setzero_pd();
+            for (int p = 0; p < k4; p += 4)
+            {
+                __m256d va = _mm256_loadu_pd(&a0[p]);
+                s0 = _mm256_fmadd_pd(va, _mm256_loadu_pd(&b0[p]), s0);
+                s1 = _mm256_fmadd_pd(va, _mm256_loadu_pd(&b1[p]), s1);
+            }
+            double r0 = hsum_avx2(s0);
+            double r1 = hsum_avx2(s1);
+            for (int p = k4; p < k; p++)
+            {
+                r0 += a0[p] * b0[p];
+                r1 += a0[p] * b1[p];
+            }
+            double *c0 = &c[i + j * ldc];
+            double *c1 = &c[i + (j + 1) * ldc];
+            *c0 = update(r0, alpha, beta, c0);
+            *c1 = update(r1, alpha, beta, c1);
+        }
+    }
+
+    // remaining column
+    for (; j < n; j++)
+    {
+        const double *b0 = &b[j * ldb];
+        for (int i = 0; i < m; i++)
+        {
+            const double *a0 = &a[i * lda];
+            __m256d s0 = _mm256_setzero_pd();
+            for (int p = 0; p < k4; p += 4)
+            {
+                s0 = _mm256_fmadd_pd(
+                    _mm256_loadu_pd(&a0[p]), _mm256_loadu_pd(&b0[p]), s0);
+            }
+            double r0 = hsum_avx2(s0);
+            for (int p = k4; p < k; p++)
+                r0 += a0[p] * b0[p];
+            double *c0 = &c[i + j * ldc];
+            *c0 = update(r0, alpha, beta, c0);
+        }
+    }
+}
+
+AVX512 static inline void update_avx512(const __m512d acc,
+                                        const __m512d alpha,
+                                        const double beta,
+                                        double *c,
+                                        const __mmask8 mask)
+{
+    __m512d r = _mm512_mul_pd(alpha, acc);
+    if (beta != 0.0)
+        r = _mm512_fmadd_pd(
+            _mm512_set1_pd(beta), _mm512_maskz_loadu_pd(mask, c), r);
+    _mm512_mask_storeu_pd(c, mask, r);
+}
+
+AVX512 static inline double hsum_avx512(const __m512d v)
+{
+    double t[8];
+    _mm512_storeu_pd(t, v);
+    return ((t[0] + t[4]) + (t[1] + t[5])) + ((t[2] + t[6]) + (t[3] + t[7]));
+}
+
+// same blocking as the AVX2 version with 16 x 4 blocks of C,
+// the remaining rows are done 8 at a time with masked loads and stores
+AVX512 static void dgemm_nn_avx512(const int m,
+                                   const int n,
+                                   const int k,
+                                   const double alpha,
+                                   const double *a,
+                                   const int lda,
+                                   const double *b,
+                                   const int ldb,
+                                   const double beta,
+                                   double *c,
+                                   const int ldc)
+{
+    const __m512d va = _mm512_set1_pd(alpha);
+    const __mmask8 full = 0xff;
+
+    int i = 0;
+    for (; i + 16 <= m; i += 16)
+    {
+        int j = 0;
+        for (; j + 4 <= n; j += 4)
+        {
+            __m512d c00 = _mm512_setzero_pd();
+            __m512d c01 = _mm512_setzero_pd();
+            __m512d c10 = _mm512_setzero_pd();
+            __m512d c11 = _mm512_setzero_pd();
+            __m512d c20 = _mm512_setzero_pd();
+            __m512d c21 = _mm512_setzero_pd();
+            __m512d c30 = _mm512_setzero_pd();
+            __m512d c31 = _mm512_setzero_pd();
+            const double *b0 = &b[j * ldb];
+            for (int p = 0; p < k; p++)
+            {
+                __m512d a0 = _mm512_loadu_pd(&a[i + p * lda]);
+                __m512d a1 = _mm512_loadu_pd(&a[i + 8 + p * lda]);
+                __m512d bb = _mm512_set1_pd(b0[p]);
+                c00 = _mm512_fmadd_pd(a0, bb, c00);
+                c01 = _mm512_fmadd_pd(a1, bb, c01);
+                bb = _mm512_set1_pd(b0[p + ldb]);
+                c10 = _mm512_fmadd_pd(a0, bb, c10);
+                c11 = _mm512_fmadd_pd(a1, bb, c11);
+                bb = _mm512_set1_pd(b0[p + 2 * ldb]);
+                c20 = _mm512_fmadd_pd(a0, bb, c20);
+                c21 = _mm512_fmadd_pd(a1, bb, c21);
+                bb = _mm512_set1_pd(b0[p + 3 * ldb]);
+                c30 = _mm512_fmadd_pd(a0, bb, c30);
+                c31 = _mm512_fmadd_pd(a1, bb, c31);
+            }
+            update_avx512(c00, va, beta, &c[i + j * ldc], full);
+            update_avx512(c01, va, beta, &c[i + 8 + j * ldc], full);
+            update_avx512(c10, va, beta, &c[i + (j + 1) * ldc], full);
+            update_avx512(c11, va, beta, &c[i + 8 + (j + 1) * ldc], full);
+            update_avx512(c20, va, beta, &c[i + (j + 2) * ldc], full);
+            update_avx512(c21, va, beta, &c[i + 8 + (j + 2) * ldc], full);
+            update_avx512(c30, va, beta, &c[i + (j + 3) * ldc], full);
+            update_avx512(c31, va, beta, &c[i + 8 + (j + 3) * ldc], full);
+        }
+        for (; j < n; j++)
+        {
+            __m512d c00 = _mm512_setzero_pd();
+            __m512d c01 = _mm512_setzero_pd();
+            for (int p = 0; p < k; p++)
+            {
+                __m512d bb = _mm512_set1_pd(b[p + j * ldb]);
+                c00 = _mm512_fmadd_pd(
+                    _mm512_loadu_pd(&a[i + p * lda]), bb, c00);
+                c01 = _mm512_fmadd_pd(
+                    _mm512_loadu_pd(&a[i + 8 + p * lda]), bb, c01);
+            }
+            update_avx512(c00, va, beta, &c[i + j * ldc], full);
+            update_avx512(c01, va, beta, &c[i + 8 + j * ldc], full);
+        }
+    }
+
+    for (; i < m; i += 8)
+    {
+        const int rows = std::min(8, m - i);
+        const __mmask8 mask = (__mmask8)((1u << rows) - 1u);
+        for (int j = 0; j < n; j++)
+        {
+            __m512d c00 = _mm512_setzero_pd();
+            for (int p = 0; p < k; p++)
+            {
+                c00 = _mm512_fmadd_pd(
+                    _mm512_maskz_loadu_pd(mask, &a[i + p * lda]),
+                    _mm512_set1_pd(b[p + j * ldb]),
+                    c00);
+            }
+            update_avx512(c00, va, beta, &c[i + j * ldc], mask);
+        }
+    }
+}
+
+// dot products along k with a masked tail instead of a scalar loop
+AVX512 static void dgemm_tn_avx512(const int m,
+                                   const int n,
+                                   const int k,
+                                   const double alpha,
+                                   const double *a,
+                                   const int lda,
+                                   const double *b,
+                                   const int ldb,
+                                   const double beta,
+                                   double *c,
+                                   const int ldc)
+{
+    const int k8 = k - k % 8;
+    const __mmask8 tail = (__mmask8)((1u << (k % 8)) - 1u);
+
+    int j = 0;
+    for (; j + 2 <= n; j += 2)
+    {
+        const double *b0 = &b[j * ldb];
+        const double *b1 = &b[(j + 1) * ldb];
+        int i = 0;
+        for (; i + 4 <= m; i += 4)
+        {
+            const double *a0 = &a[i * lda];
+            const double *a1 = &a[(i + 1) * lda];
+            const double *a2 = &a[(i + 2) * lda];
+            const double *a3 = &a[(i + 3) * lda];
+            __m512d s00 = _mm512_setzero_pd();
+            __m512d s10 = _mm512_setzero_pd();
+            __m512d s20 = _mm512_setzero_pd();
+            __m512d s30 = _mm512_setzero_pd();
+            __m512d s01 = _mm512_setzero_pd();
+            __m512d s11 = _mm512_setzero_pd();
+            __m512d s21 = _mm512_setzero_pd();
+            __m512d s31 = _mm512_setzero_pd();
+            for (int p = 0; p < k; p += 8)
+            {
+                const __mmask8 mask = (p < k8) ? (__mmask8)0xff : tail;
+                __m512d vb0 = _mm512_maskz_loadu_pd(mask, &b0[p]);
+                __m512d vb1 = _mm512_maskz_loadu_pd(mask, &b1[p]);
+                __m512d va = _mm512_maskz_loadu_pd(mask, &a0[p]);
+                s00 = _mm512_fmadd_pd(va, vb0, s00);
+                s01 = _mm512_fmadd_pd(va, vb1, s01);
+                va = _mm512_maskz_loadu_pd(mask, &a1[p]);
+                s10 = _mm512_fmadd_pd(va, vb0, s10);
+                s11 = _mm512_fmadd_pd(va, vb1, s11);
+                va = _mm512_maskz_loadu_pd(mask, &a2[p]);
+                s20 = _mm512_fmadd_pd(va, vb0, s20);
+                s21 = _mm512_fmadd_pd(va, vb1, s21);
+                va = _mm512_maskz_loadu_pd(mask, &a3[p]);
+                s30 = _mm512_fmadd_pd(va, vb0, s30);
+                s31 = _mm512_fmadd_pd(va, vb1, s31);
+            }
+            double r[8] = {hsum_avx512(s00),
+                           hsum_avx512(s10),
+                           hsum_avx512(s20),
+                           hsum_avx512(s30),
+                           hsum_avx512(s01),
+                           hsum_avx512(s11),
+                           hsum_avx512(s21),
+                           hsum_avx512(s31)};
+            for (int ii = 0; ii < 4; ii++)
+            {
+                double *c0 = &c[i + ii + j * ldc];
+                double *c1 = &c[i + ii + (j + 1) * ldc];
+                *c0 = update(r[ii], alpha, beta, c0);
+                *c1 = update(r[4 + ii], alpha, beta, c1);
+            }
+        }
+        for (; i < m; i++)
+        {
+            const double *a0 = &a[i * lda];
+            __m512d s0 = _mm512_setzero_pd();
+            __m512d s1 = _mm512_setzero_pd();
+            for (int p = 0; p < k; p += 8)
+            {
+                const __mmask8 mask = (p < k8) ? (__mmask8)0xff : tail;
+                __m512d va = _mm512_maskz_loadu_pd(mask, &a0[p]);
+                s0 = _mm512_fmadd_pd(
+                    va, _mm512_maskz_loadu_pd(mask, &b0[p]), s0);
+                s1 = _mm512_fmadd_pd(
+                    va, _mm512_maskz_loadu_pd(mask, &b1[p]), s1);
+            }
+            double *c0 = &c[i + j * ldc];
+            double *c1 = &c[i + (j + 1) * ldc];
+            *c0 = update(hsum_avx512(s0), alpha, beta, c0);
+            *c1 = update(hsum_avx512(s1), alpha, beta, c1);
+        }
+    }
+
+    // remaining column
+    for (; j < n; j++)
+    {
+        const double *b0 = &b[j * ldb];
+        for (int i = 0; i < m; i++)
+        {
+            const double *a0 = &a[i * lda];
+            __m512d s0 = _mm512_setzero_pd();
+            for (int p = 0; p < k; p += 8)
+            {
+                const __mmask8 mask = (p < k8) ? (__mmask8)0xff : tail;
+                s0 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, &a0[p]),
+                                     _mm512_maskz_loadu_pd(mask, &b0[p]),
+                                     s0);
+            }
+            double *c0 = &c[i + j * ldc];
+            *c0 = update(hsum_avx512(s0), alpha, beta, c0);
+        }
+    }
+}
+
+typedef void (*kernel_t)(const int,
+                         const int,
+                         const int,
+                         const double,
+                         const double *,
+                         const int,
+                         const double *,
+                         const int,
+                         const double,
+                         double *,
+                         const int);
+
+enum
+{
+    CHOICE_UNKNOWN = 0,
+    CHOICE_BLAS,
+    CHOICE_KERNEL
+};
+
+// shapes are binned to multiples of 8 in every dimension, similar
+// shapes perform alike and this keeps the cache small since the number
+// of compressed AOs changes from batch to batch
+static unsigned long long shape_key(const int op,
+                                    const int m,
+                                    const int n,
+                                    const int k)
+{
+    unsigned long long key = op;
+    key = (key << 20) | (unsigned long long)((m + 7) / 8);
+    key = (key << 20) | (unsigned long long)((n + 7) / 8);
+    key = (key << 20) | (unsigned long long)((k + 7) / 8);
+    return key;
+}
+
+static int &get_choice(const unsigned long long key)
+{
+    static thread_local std::unordered_map<unsigned long long, int> cache;
+    return cache[key];
+}
+
+// fixed choice measured against OpenBLAS; the nn kernel wins except for
+// a single block of rows with a long inner dimension, the tn kernel
+// computes dot products along k and needs k of at least 64 to fill the
+// vectors; the rule works on the binned shape so that it agrees with
+// the cache key
+static int choose(const int op, const int m, const int k)
+{
+    const int mb = (m + 7) / 8;
+    const int kb = (k + 7) / 8;
+    if (op == 1)
+        return (mb == 1 and kb > 16) ? CHOICE_BLAS : CHOICE_KERNEL;
+    return (kb >= 8) ? CHOICE_KERNEL : CHOICE_BLAS;
+}
+
+// timing replaces the fixed rule only on request since it makes the
+// choice, and with it the rounding, depend on the machine load
+static bool autotune()
+{
+    static const bool enabled = (getenv("XCINT_GEMM_AUTOTUNE") != NULL);
+    return enabled;
+}
+
+// runs the kernel or BLAS depending on the cached choice for this shape;
+// the choice comes from the fixed rule unless XCINT_GEMM_AUTOTUNE is set,
+// then the first time a shape is seen both are timed, C receives the
+// BLAS result in that case and the kernel works on a copy
+static void dispatch(const int op,
+                     kernel_t kernel,
+                     char ta,
+                     char tb,
+                     int m,
+                     int n,
+                     int k,
+                     double alpha,
+                     const double *a,
+                     int lda,
+                     const double *b,
+                     int ldb,
+                     double beta,
+                     double *c,
+                     int ldc)
+{
+    int &choice = get_choice(shape_key(op, m, n, k));
+
+    if (choice == CHOICE_UNKNOWN and not autotune())
+        choice = choose(op, m, k);
+
+    if (choice == CHOICE_KERNEL)
+    {
+        kernel(m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+        return;
+    }
+    if (choice == CHOICE_BLAS)
+    {
+        dgemm_(&ta, &tb, &m, &n, &k, &alpha, a, &lda, b, &ldb, &beta, c, &ldc);
+        return;
+    }
+
+    typedef std::chrono::steady_clock clock;
+
+    std::vector<double> c_copy(ldc * n);
+    std::copy(&c[0], &c[ldc * (n - 1) + m], c_copy.begin());
+
+    // untimed warm-up so that both timings see warm operands
+    kernel(m, n, k, alpha, a, lda, b, ldb, beta, c_copy.data(), ldc);
+    std::copy(&c[0], &c[ldc * (n - 1) + m], c_copy.begin());
+
+    clock::time_point t0 = clock::now();
+    dgemm_(&ta, &tb, &m, &n, &k, &alpha, a, &lda, b, &ldb, &beta, c, &ldc);
+    clock::time_point t1 = clock::now();
+    kernel(m, n, k, alpha, a, lda, b, ldb, beta, c_copy.data(), ldc);
+    clock::time_point t2 = clock::now();
+
+    choice = (t2 - t1 < t1 - t0) ? CHOICE_KERNEL : CHOICE_BLAS;
+}
+
+bool small_dgemm(char ta,
+                 char tb,
+                 int m,
+                 int n,
+                 int k,
+                 double alpha,
+                 const double *a,
+                 int lda,
+                 const double *b,
+                 int ldb,
+                 double beta,
+                 double *c,
+                 int ldc)
+{
+    isa_t isa = get_isa();
+    if (isa == ISA_NONE)
+        return false;
+    if (m < 1 or n < 1 or k < 1)
+        return false;
+    if ((double)m * n * k > SMALL_GEMM_MAX_WORK)
+        return false;
+
+    kernel_t kernel = NULL;
+    int op = 0;
+    if (ta == 'n' and tb == 'n')
+    {
+        kernel = (isa == ISA_AVX512) ? dgemm_nn_avx512 : dgemm_nn_avx2;
+        op = 1;
+    }
+    if (ta == 't' and tb == 'n')
+    {
+        kernel = (isa == ISA_AVX512) ? dgemm_tn_avx512 : dgemm_tn_avx2;
+        op = 2;
+    }
+    if (kernel == NULL)
+        return false;
+
+    dispatch(op, kernel, ta, tb, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+    return true;
+}
+
+// C(m, n) = alpha B(m, n) A(n, n) + beta C(m, n) with A symmetric and
+// only its upper triangle referenced; A is expanded into a full
+// temporary and the product is done by small_dgemm
+bool small_dsymm(char si,
+                 char up,
+                 int m,
+                 int n,
+                 double alpha,
+                 const double *a,
+                 int lda,
+                 const double *b,
+                 int ldb,
+                 double beta,
+                 double *c,
+                 int ldc)
+{
+    if (si != 'r' or up != 'u')
+        return false;
+    if (get_isa() == ISA_NONE)
+        return false;
+    if (m < 1 or n < 1)
+        return false;
+    if ((double)m * n * n > SMALL_GEMM_MAX_WORK)
+        return false;
+
+    static thread_local std::vector<double> full;
+    full.resize(n * n);
+    for (int j = 0; j < n; j++)
+    {
+        for (int i = 0; i <= j; i++)
+        {
+            full[i + j * n] = a[i + j * lda];
+            full[j + i * n] = a[i + j * lda];
+        }
+    }
+
+    return small_dgemm(
+        'n', 'n', m, n, n, alpha, b, ldb, full.data(), n, beta, c, ldc);
+}
+
+#else
+
+bool small_dgemm(char,
+                 char,
+                 int,
+                 int,
+                 int,
+                 double,
+                 const double *,
+                 int,
+                 const double *,
+                 int,
+                 double,
+                 double *,
+                 int)
+{
+    return false;
+}
+
+bool small_dsymm(char,
+                 char,
+                 int,
+                 int,
+                 double,
+                 const double *,
+                 int,
+                 const double *,
+                 int,
+                 double,
+                 double *,
+                 int)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+
+// in-tree register-blocked kernels (AVX2 and AVX-512) for the small
+// matrix multiplications which appear after AO compression, typically
+// tens to a few hundred AOs against one batch of points, where the call
+// overhead and packing inside vendor BLAS dominate
+//
+// both functions follow the fortran BLAS conventions (column-major) and
+// return false if they did not handle the call, in which case the caller
+// falls back to BLAS; this happens for large shapes, for operand
+// combinations without a kernel, on CPUs without AVX2, and for shapes
+// where a fixed size rule prefers BLAS (the choice is cached per shape
+// and thread; with XCINT_GEMM_AUTOTUNE set it is timed instead)
+
+bool small_dgemm(char ta,
+                 char tb,
+                 int m,
+                 int n,
+                 int k,
+                 double alpha,
+                 const double *a,
+                 int lda,
+                 const double *b,
+                 int ldb,
+                 double beta,
+                 double *c,
+                 int ldc);
+
+bool small_dsymm(char si,
+                 char up,
+                 int m,
+                 int n,
+                 double alpha,
+                 const double *a,
+                 int lda,
+                 const double *b,
+                 int ldb,
+                 double beta,
+                 double *c,
+                 int ldc);
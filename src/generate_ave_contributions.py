@@ -31,6 +31,7 @@ def get_fortran_code(j, density_index, dmat_index_rest):
     for i in j:
         s += '        coor.push_back(geo_coor[%i]);\n' % int(i-1)
     s += '            get_dens_geo_derv(mat_dim,\n'
+    s += '                              matrix_layout,\n'
     s += '                              num_aos,\n'
     s += '                              block_length,\n'
     s += '                              buffer_len,\n'
@@ -28,7 +28,15 @@ xcint_context_t *xcint_new_context()
 {
     return AS_TYPE(xcint_context_t, new XCint());
 }
-XCint::XCint() { balboa_context = balboa_new_context(); }
+XCint::XCint()
+{
+    balboa_context = balboa_new_context();
+    cartesian_context = balboa_new_context();
+    ao_context = balboa_context;
+    use_cartesian_dmat = false;
+    use_mixed_precision = false;
+    num_basis_centers = 0;
+}
 
 XCINT_API
 void xcint_free_context(xcint_context_t *xcint_context)
@@ -37,7 +45,11 @@ void xcint_free_context(xcint_context_t *xcint_context)
         return;
     delete AS_TYPE(XCint, xcint_context);
 }
-XCint::~XCint() { balboa_free_context(balboa_context); }
+XCint::~XCint()
+{
+    balboa_free_context(balboa_context);
+    balboa_free_context(cartesian_context);
+}
 
 XCINT_API
 int xcint_set_functional(xcint_context_t *context,       char *line)
@@ -50,6 +62,59 @@ int XCint::set_functional(      char *line)
     return 0;
 }
 
+XCINT_API
+int xcint_set_precision(xcint_context_t *context,
+                        const xcint_precision_t precision)
+{
+    return AS_TYPE(XCint, context)->set_precision(precision);
+}
+int XCint::set_precision(const xcint_precision_t precision)
+{
+    switch (precision)
+    {
+    case XCINT_PRECISION_DOUBLE:
+        use_mixed_precision = false;
+        break;
+    case XCINT_PRECISION_MIXED:
+        use_mixed_precision = true;
+        break;
+    default:
+        fprintf(stderr, "ERROR: precision not recognized.\n");
+        return -1;
+    }
+    return 0;
+}
+
+XCINT_API
+int xcint_set_spherical_transform(xcint_context_t *context,
+                                  const xcint_transform_t transform)
+{
+    return AS_TYPE(XCint, context)->set_spherical_transform(transform);
+}
+int XCint::set_spherical_transform(const xcint_transform_t transform)
+{
+    if (num_basis_centers > 0)
+    {
+        fprintf(stderr,
+                "ERROR: set the spherical transform before the basis.\n");
+        return -1;
+    }
+
+    switch (transform)
+    {
+    case XCINT_TRANSFORM_AO:
+        use_cartesian_dmat = false;
+        break;
+    case XCINT_TRANSFORM_DMAT:
+        use_cartesian_dmat = true;
+        break;
+    default:
+        fprintf(stderr, "ERROR: spherical transform not recognized.\n");
+        return -1;
+    }
+    return 0;
+}
+
 XCINT_API
 int xcint_set_basis(xcint_context_t *context,
                     const xcint_basis_t basis_type,
@@ -83,6 +148,12 @@ int XCint::set_basis(const int basis_type,
                      const double primitive_exponents[],
                      const double contraction_coefficients[])
 {
+    if (basis_type == XCINT_BASIS_CARTESIAN)
+    {
+        fprintf(stderr, "ERROR: XCINT_BASIS_CARTESIAN not tested.\n");
+        exit(-1);
+    }
+
     int ierr = balboa_set_basis(balboa_context,
                                 basis_type,
                                 num_centers,
@@ -94,38 +165,127 @@ int XCint::set_basis(const int basis_type,
                                 primitive_exponents,
                                 contraction_coefficients);
 
+    // a new basis invalidates any block pattern
+    int num_aos = balboa_get_num_aos(balboa_context);
+    matrix_layout.set_dense(num_aos);
+    num_basis_centers = num_centers;
+
+    ao_context = balboa_context;
+    if (use_cartesian_dmat and ierr == 0)
+    {
+        ierr = balboa_set_basis(cartesian_context,
+                                XCINT_BASIS_CARTESIAN,
+                                num_centers,
+                                center_coordinates_bohr,
+                                num_shells,
+                                shell_centers,
+                                shell_l_quantum_numbers,
+                                shell_num_primitives,
+                                primitive_exponents,
+                                contraction_coefficients);
+        ao_context = cartesian_context;
+
+        cs_transform.clear();
+        cs_transform_off.resize(num_shells);
+        for (int ishell = 0; ishell < num_shells; ishell++)
+        {
+            int l = shell_l_quantum_numbers[ishell];
+            int len = (l + 1) * (l + 2) / 2 * (2 * l + 1);
+            cs_transform_off[ishell] = cs_transform.size();
+            cs_transform.resize(cs_transform.size() + len);
+            balboa_get_spherical_transform(
+                cartesian_context,
+                ishell,
+                &cs_transform[cs_transform_off[ishell]]);
+        }
+    }
+
     return ierr;
 }
 
-void XCint::integrate_batch(const double dmat[],
-                                  xcfun_t *xcfun,
-                                  Functional *fun,
-                            const bool get_exc,
-                            double &exc,
-                            const bool get_vxc,
-                            double vxc[],
-                            double &num_electrons,
-                            const int geo_coor[],
-                            const bool use_dmat[],
-                            const int num_dmat,
-                            const int perturbation_indices[],
-                            const int ipoint,
-                            const int geo_derv_order,
-                            const int max_ao_order_g,
-                            const int block_length,
-                            const int num_variables,
-                            const int num_perturbations,
-                            const int num_fields,
-                            const int mat_dim,
-                            const bool get_gradient,
-                            const bool get_tau,
-                            const int dmat_index[],
-                            const double grid_x_bohr[],
-                            const double grid_y_bohr[],
-                            const double grid_z_bohr[],
-                            const double grid_w[])
+XCINT_API
+int xcint_set_matrix_storage(xcint_context_t *context,
+                             const xcint_storage_t storage,
+                             const int num_blocks,
+                             const int block_centers[])
+{
+    return AS_TYPE(XCint, context)
+        ->set_matrix_storage(storage, num_blocks, block_centers);
+}
+int XCint::set_matrix_storage(const xcint_storage_t storage,
+                              const int num_blocks,
+                              const int block_centers[])
+{
+    int num_aos = balboa_get_num_aos(balboa_context);
+    if (num_aos < 1)
+    {
+        fprintf(stderr, "ERROR: set the basis before the matrix storage.\n");
+        return -1;
+    }
+
+    switch (storage)
+    {
+    case XCINT_STORAGE_DENSE:
+        matrix_layout.set_dense(num_aos);
+        break;
+    case XCINT_STORAGE_PACKED:
+        matrix_layout.set_packed(num_aos);
+        break;
+    case XCINT_STORAGE_BLOCK_SPARSE:
+    {
+        int *ao_centers = new int[num_aos];
+        for (int i = 0; i < num_aos; i++)
+        {
+            ao_centers[i] = balboa_get_ao_center(balboa_context, i);
+        }
+        int ierr = matrix_layout.set_block_sparse(num_aos,
+                                                  num_basis_centers,
+                                                  ao_centers,
+                                                  num_blocks,
+                                                  block_centers);
+        delete[] ao_centers;
+        return ierr;
+    }
+    default:
+        fprintf(stderr, "ERROR: matrix storage not recognized.\n");
+        return -1;
+    }
+    return 0;
+}
+
+int XCint::integrate_batch(balboa_workspace_t *workspace,
+                           const double dmat[],
+                                 xcfun_t *xcfun,
+                                 Functional *fun,
+                           const bool get_exc,
+                           double &exc,
+                           const bool get_vxc,
+                           double vxc[],
+                           double &num_electrons,
+                           const int geo_coor[],
+                           const bool use_dmat[],
+                           const int num_dmat,
+                           const int perturbation_indices[],
+                           const int ipoint,
+                           const int geo_derv_order,
+                           const int max_ao_order_g,
+                           const int block_length,
+                           const int num_variables,
+                           const int num_perturbations,
+                           const int num_fields,
+                           const int mat_dim,
+                           const bool get_gradient,
+                           const bool get_tau,
+                           const int dmat_index[],
+                           const double grid_x_bohr[],
+                           const double grid_y_bohr[],
+                           const double grid_z_bohr[],
+                           const double grid_w[])
 //  const double grid_w[]) const
 {
+    // length of one matrix in dmat
+    int mat_len = matrix_layout.get_length();
+
     double *n = new double[AO_BLOCK_LENGTH * num_variables * MAX_NUM_DENSITIES];
     double *u = new double[AO_BLOCK_LENGTH * num_variables];
 
@@ -138,22 +298,41 @@ void XCint::integrate_batch(const double dmat[],
     int max_ao_geo_order = max_ao_order_g; // FIXME
 
     int buffer_len = balboa_get_buffer_len(
-        balboa_context, max_ao_geo_order, AO_BLOCK_LENGTH);
+        ao_context, max_ao_geo_order, AO_BLOCK_LENGTH);
     //  FIXME should be:
-    //  int buffer_len = balboa_get_buffer_len(balboa_context, max_ao_geo_order,
+    //  int buffer_len = balboa_get_buffer_len(ao_context, max_ao_geo_order,
     //  block_length);
 
+    // balboa_get_ao zeroes the AOs it does not compute
     double *ao = new double[buffer_len];
 
-    std::fill(&ao[0], &ao[buffer_len], 0.0);
+    // the geometric derivative slices are only used for AOs on the
+    // differentiated centers (see compress), all other AOs only need
+    // the orders of the functional
+    std::vector<int> derv_centers;
+    for (int i = 0; i < geo_derv_order; i++)
+    {
+        derv_centers.push_back((geo_coor[i] - 1) / 3);
+    }
 
-    int ierr = balboa_get_ao(balboa_context,
-                             max_ao_geo_order,
-                             block_length,
-                             &grid_x_bohr[ipoint],
-                             &grid_y_bohr[ipoint],
-                             &grid_z_bohr[ipoint],
-                             ao);
+    int ierr = balboa_get_ao_on_centers(ao_context,
+                                        workspace,
+                                        max_ao_geo_order,
+                                        max_ao_geo_order - geo_derv_order,
+                                        geo_derv_order,
+                                        derv_centers.data(),
+                                        block_length,
+                                        &grid_x_bohr[ipoint],
+                                        &grid_y_bohr[ipoint],
+                                        &grid_z_bohr[ipoint],
+                                        ao);
+    if (ierr != 0)
+    {
+        delete[] n;
+        delete[] u;
+        delete[] ao;
+        return ierr;
+    }
 
     if (!n_is_used[0])
     {
@@ -162,17 +341,26 @@ void XCint::integrate_batch(const double dmat[],
     }
 
     double *ao_compressed = new double[buffer_len];
+    float *ao_compressed_single = NULL;
+    if (use_mixed_precision)
+        ao_compressed_single = new float[buffer_len];
     int *ao_compressed_index = new int[buffer_len];
     int ao_compressed_num;
-    int num_aos = balboa_get_num_aos(balboa_context);
+    int num_aos = balboa_get_num_aos(ao_context);
     int *ao_centers = new int[num_aos];
     for (int i = 0; i < num_aos; i++)
     {
-        ao_centers[i] = balboa_get_ao_center(balboa_context, i);
+        ao_centers[i] = balboa_get_ao_center(ao_context, i);
+    }
+    int num_shells = balboa_get_num_shells(ao_context);
+    int *shell_off = new int[num_shells];
+    for (int i = 0; i < num_shells; i++)
+    {
+        shell_off[i] = balboa_get_shell_off(ao_context, i);
     }
     int slice_offsets[4];
     auto get_geo_offset = [&](int i, int j, int k) {
-        return balboa_get_geo_offset(balboa_context, i, j, k);
+        return balboa_get_geo_offset(ao_context, i, j, k);
     };
 
     compute_slice_offsets(std::vector<int>(), slice_offsets);
@@ -181,12 +369,16 @@ void XCint::integrate_batch(const double dmat[],
              ao_compressed_num,
              ao_compressed_index,
              ao_compressed,
+             ao_compressed_single,
              num_aos,
              ao,
              ao_centers,
+             num_shells,
+             shell_off,
              std::vector<int>(),
              slice_offsets);
     get_density(mat_dim,
+                matrix_layout,
                 block_length,
                 get_gradient,
                 get_tau,
@@ -200,13 +392,43 @@ void XCint::integrate_batch(const double dmat[],
                 ao_compressed,
                 ao_compressed_num,
                 ao_compressed_index,
-                ao_compressed);
+                ao_compressed,
+                ao_compressed_single);
 
     for (int ib = 0; ib < block_length; ib++)
     {
         num_electrons += grid_w[ipoint + ib] * n[ib];
     }
 
+    // density of one of the perturbed matrices, offset locates it in dmat;
+    // symmetric matrices take the lower triangle and dsymm path,
+    // antisymmetric ones (magnetic perturbations) give no density
+    auto get_perturbed_density = [&](double density[], const int offset) {
+        matrix_symmetry_t symmetry = MATRIX_GENERAL;
+        if (offset / mat_len < (int)dmat_symmetry.size())
+            symmetry = dmat_symmetry[offset / mat_len];
+        if (symmetry == MATRIX_ANTISYMMETRIC)
+            return;
+        bool is_symmetric = (symmetry == MATRIX_SYMMETRIC);
+        get_density(mat_dim,
+                    matrix_layout,
+                    block_length,
+                    get_gradient,
+                    get_tau,
+                    prefactors,
+                    density,
+                    &dmat[offset],
+                    is_symmetric,
+                    is_symmetric,
+                    ao_compressed_num,
+                    ao_compressed_index,
+                    ao_compressed,
+                    ao_compressed_num,
+                    ao_compressed_index,
+                    ao_compressed,
+                    ao_compressed_single);
+    };
+
     // expectation value contribution
     if (get_exc)
     {
@@ -252,22 +474,8 @@ void XCint::integrate_batch(const double dmat[],
                               0.0);
                     n_is_used[k] = true;
                 }
-                get_density(
-                    mat_dim,
-                    block_length,
-                    get_gradient,
-                    get_tau,
-                    prefactors,
-                    &n[k * block_length * num_variables],
-                    &dmat[dmat_index[k]],
-                    false,
-                    false, // FIXME can be true based on dmat, saving possible
-                    ao_compressed_num,
-                    ao_compressed_index,
-                    ao_compressed,
-                    ao_compressed_num,
-                    ao_compressed_index,
-                    ao_compressed);
+                get_perturbed_density(&n[k * block_length * num_variables],
+                                      dmat_index[k]);
             }
         }
 
@@ -337,23 +545,8 @@ void XCint::integrate_batch(const double dmat[],
                               0.0);
                     n_is_used[k] = true;
                 }
-                get_density(
-                    mat_dim,
-                    block_length,
-                    get_gradient,
-                    get_tau,
-                    prefactors,
-                    &n[k * block_length * num_variables],
-                    &dmat[(ifield + 1) * mat_dim * mat_dim],
-                    false,
-                    false, // FIXME can be true depending on perturbation
-                           // (savings possible)
-                    ao_compressed_num,
-                    ao_compressed_index,
-                    ao_compressed,
-                    ao_compressed_num,
-                    ao_compressed_index,
-                    ao_compressed);
+                get_perturbed_density(&n[k * block_length * num_variables],
+                                      (ifield + 1) * mat_len);
             }
 
             distribute_matrix2(block_length,
@@ -391,6 +584,7 @@ void XCint::integrate_batch(const double dmat[],
                 }
                 coor.push_back(geo_coor[0]);
                 get_dens_geo_derv(mat_dim,
+                                  matrix_layout,
                                   num_aos,
                                   block_length,
                                   buffer_len,
@@ -405,22 +599,8 @@ void XCint::integrate_batch(const double dmat[],
                 coor.clear();
                 if (num_dmat > 1)
                 {
-                    get_density(
-                        mat_dim,
-                        block_length,
-                        get_gradient,
-                        get_tau,
-                        prefactors,
-                        &n[k * block_length * num_variables],
-                        &dmat[perturbation_indices[1] * mat_dim * mat_dim],
-                        false,
-                        false,
-                        ao_compressed_num,
-                        ao_compressed_index,
-                        ao_compressed,
-                        ao_compressed_num,
-                        ao_compressed_index,
-                        ao_compressed);
+                    get_perturbed_density(&n[k * block_length * num_variables],
+                                          perturbation_indices[1] * mat_len);
                 }
                 distribute_matrix2(block_length,
                                    num_variables,
@@ -502,6 +682,7 @@ void XCint::integrate_batch(const double dmat[],
                 }
                 coor.push_back(geo_coor[1]);
                 get_dens_geo_derv(mat_dim,
+                                  matrix_layout,
                                   num_aos,
                                   block_length,
                                   buffer_len,
@@ -545,6 +726,7 @@ void XCint::integrate_batch(const double dmat[],
                 }
                 coor.push_back(geo_coor[0]);
                 get_dens_geo_derv(mat_dim,
+                                  matrix_layout,
                                   num_aos,
                                   block_length,
                                   buffer_len,
@@ -590,6 +772,7 @@ void XCint::integrate_batch(const double dmat[],
                 }
                 coor.push_back(geo_coor[0]);
                 get_dens_geo_derv(mat_dim,
+                                  matrix_layout,
                                   num_aos,
                                   block_length,
                                   buffer_len,
@@ -612,6 +795,7 @@ void XCint::integrate_batch(const double dmat[],
                 }
                 coor.push_back(geo_coor[1]);
                 get_dens_geo_derv(mat_dim,
+                                  matrix_layout,
                                   num_aos,
                                   block_length,
                                   buffer_len,
@@ -635,6 +819,7 @@ void XCint::integrate_batch(const double dmat[],
                 coor.push_back(geo_coor[0]);
                 coor.push_back(geo_coor[1]);
                 get_dens_geo_derv(mat_dim,
+                                  matrix_layout,
                                   num_aos,
                                   block_length,
                                   buffer_len,
@@ -681,23 +866,8 @@ void XCint::integrate_batch(const double dmat[],
                               0.0);
                     n_is_used[k] = true;
                 }
-                get_density(
-                    mat_dim,
-                    block_length,
-                    get_gradient,
-                    get_tau,
-                    prefactors,
-                    &n[k * block_length * num_variables],
-                    &dmat[perturbation_indices[2] * mat_dim * mat_dim],
-                    false,
-                    false, // FIXME can be true depending on perturbation
-                           // (savings possible)
-                    ao_compressed_num,
-                    ao_compressed_index,
-                    ao_compressed,
-                    ao_compressed_num,
-                    ao_compressed_index,
-                    ao_compressed);
+                get_perturbed_density(&n[k * block_length * num_variables],
+                                      perturbation_indices[2] * mat_len);
                 coor.push_back(geo_coor[0]);
                 distribute_matrix2(block_length,
                                    num_variables,
@@ -730,6 +900,7 @@ void XCint::integrate_batch(const double dmat[],
                 }
                 coor.push_back(geo_coor[0]);
                 get_dens_geo_derv(mat_dim,
+                                  matrix_layout,
                                   num_aos,
                                   block_length,
                                   buffer_len,
@@ -742,23 +913,8 @@ void XCint::integrate_batch(const double dmat[],
                                   &n[k * block_length * num_variables],
                                   &dmat[0]);
                 coor.clear();
-                get_density(
-                    mat_dim,
-                    block_length,
-                    get_gradient,
-                    get_tau,
-                    prefactors,
-                    &n[k * block_length * num_variables],
-                    &dmat[perturbation_indices[1] * mat_dim * mat_dim],
-                    false,
-                    false, // FIXME can be true depending on perturbation
-                           // (savings possible)
-                    ao_compressed_num,
-                    ao_compressed_index,
-                    ao_compressed,
-                    ao_compressed_num,
-                    ao_compressed_index,
-                    ao_compressed);
+                get_perturbed_density(&n[k * block_length * num_variables],
+                                      perturbation_indices[1] * mat_len);
                 k = 2;
                 if (!n_is_used[k])
                 {
@@ -767,23 +923,8 @@ void XCint::integrate_batch(const double dmat[],
                               0.0);
                     n_is_used[k] = true;
                 }
-                get_density(
-                    mat_dim,
-                    block_length,
-                    get_gradient,
-                    get_tau,
-                    prefactors,
-                    &n[k * block_length * num_variables],
-                    &dmat[perturbation_indices[2] * mat_dim * mat_dim],
-                    false,
-                    false, // FIXME can be true depending on perturbation
-                           // (savings possible)
-                    ao_compressed_num,
-                    ao_compressed_index,
-                    ao_compressed,
-                    ao_compressed_num,
-                    ao_compressed_index,
-                    ao_compressed);
+                get_perturbed_density(&n[k * block_length * num_variables],
+                                      perturbation_indices[2] * mat_len);
                 k = 3;
                 if (!n_is_used[k])
                 {
@@ -794,6 +935,7 @@ void XCint::integrate_batch(const double dmat[],
                 }
                 coor.push_back(geo_coor[0]);
                 get_dens_geo_derv(mat_dim,
+                                  matrix_layout,
                                   num_aos,
                                   block_length,
                                   buffer_len,
@@ -804,27 +946,12 @@ void XCint::integrate_batch(const double dmat[],
                                   coor,
                                   get_geo_offset,
                                   &n[k * block_length * num_variables],
-                                  &dmat[perturbation_indices[2] * mat_dim * mat_dim]);
+                                  &dmat[perturbation_indices[2] * mat_len]);
                 coor.clear();
                 if (num_dmat > 3)
                 {
-                    get_density(
-                        mat_dim,
-                        block_length,
-                        get_gradient,
-                        get_tau,
-                        prefactors,
-                        &n[k * block_length * num_variables],
-                        &dmat[perturbation_indices[3] * mat_dim * mat_dim],
-                        false,
-                        false, // FIXME can be true depending on perturbation
-                               // (savings possible)
-                        ao_compressed_num,
-                        ao_compressed_index,
-                        ao_compressed,
-                        ao_compressed_num,
-                        ao_compressed_index,
-                        ao_compressed);
+                    get_perturbed_density(&n[k * block_length * num_variables],
+                                          perturbation_indices[3] * mat_len);
                 }
                 distribute_matrix2(block_length,
                                    num_variables,
@@ -864,8 +991,12 @@ void XCint::integrate_batch(const double dmat[],
     delete[] u;
     delete[] ao;
     delete[] ao_compressed;
+    delete[] ao_compressed_single;
     delete[] ao_compressed_index;
     delete[] ao_centers;
+    delete[] shell_off;
+
+    return 0;
 }
 
 XCINT_API
@@ -968,286 +1099,1338 @@ int XCint::integrate(const xcint_mode_t mode,
                      //  double *num_electrons) const
                      double *num_electrons)
 {
-    assert(mode == XCINT_MODE_RKS);
-
-    std::vector<int> coor;
-
-    int mat_dim = balboa_get_num_aos(balboa_context);
-
-    int geo_derv_order = 0;
-    int num_fields = 0;
-    for (int i = 0; i < num_perturbations; i++)
+    if (not use_cartesian_dmat)
     {
-        if (perturbations[i] == XCINT_PERT_GEO)
-            geo_derv_order++;
-        if (perturbations[i] == XCINT_PERT_EL)
-            num_fields++;
+        return integrate_points(mode,
+                                num_points,
+                                grid_x_bohr,
+                                grid_y_bohr,
+                                grid_z_bohr,
+                                grid_w,
+                                num_perturbations,
+                                perturbations,
+                                components,
+                                num_dmat,
+                                perturbation_indices,
+                                dmat,
+                                get_exc,
+                                exc,
+                                get_vxc,
+                                vxc,
+                                num_electrons);
     }
 
-    int *geo_coor = NULL;
-    if (geo_derv_order > 0)
+    // the matrices are transformed to the Cartesian basis once here
+    // and the points see dense Cartesian matrices and Cartesian AOs
+    int mat_len = matrix_layout.get_length();
+    int cart_dim = balboa_get_num_aos(cartesian_context);
+    int cart_len = cart_dim * cart_dim;
+
+    double *dmat_cart = new double[num_dmat * cart_len];
+    for (int k = 0; k < num_dmat; k++)
     {
-        geo_coor = new int[geo_derv_order];
-        for (int i = 0; i < num_perturbations; i++)
-        {
-            if (perturbations[i] == XCINT_PERT_GEO)
-                geo_coor[i] = components[2 * i]; // FIXME
-        }
+        transform_to_cartesian(&dmat[k * mat_len], &dmat_cart[k * cart_len]);
     }
-
-    *exc = 0.0;
-    *num_electrons = 0.0;
+    double *vxc_cart = NULL;
+    if (get_vxc)
+        vxc_cart = new double[cart_len];
+
+    MatrixLayout user_layout = matrix_layout;
+    matrix_layout.set_dense(cart_dim);
+    int ierr = integrate_points(mode,
+                                num_points,
+                                grid_x_bohr,
+                                grid_y_bohr,
+                                grid_z_bohr,
+                                grid_w,
+                                num_perturbations,
+                                perturbations,
+                                components,
+                                num_dmat,
+                                perturbation_indices,
+                                dmat_cart,
+                                get_exc,
+                                exc,
+                                get_vxc,
+                                vxc_cart,
+                                num_electrons);
+    matrix_layout = user_layout;
 
     if (get_vxc)
-        std::fill(&vxc[0], &vxc[mat_dim * mat_dim], 0.0);
+        transform_to_spherical(vxc_cart, vxc);
 
-    bool get_gradient;
-    bool get_tau;
+    delete[] dmat_cart;
+    delete[] vxc_cart;
 
-    int *dmat_index = new int[MAX_NUM_DENSITIES];
-    std::fill(&dmat_index[0], &dmat_index[MAX_NUM_DENSITIES], 0);
+    return ierr;
+}
 
-    bool *use_dmat = new bool[MAX_NUM_DENSITIES];
-    std::fill(&use_dmat[0], &use_dmat[MAX_NUM_DENSITIES], false);
+XCINT_API
+int xcint_integrate_gradient(xcint_context_t *context,
+                             const xcint_mode_t mode,
+                             const int num_points,
+                             const double grid_x_bohr[],
+                             const double grid_y_bohr[],
+                             const double grid_z_bohr[],
+                             const double grid_w[],
+                             const double dmat[],
+                             double gradient[])
+{
+    return AS_TYPE(XCint, context)
+        ->integrate_gradient(mode,
+                             num_points,
+                             grid_x_bohr,
+                             grid_y_bohr,
+                             grid_z_bohr,
+                             grid_w,
+                             dmat,
+                             gradient);
+}
+int XCint::integrate_gradient(const xcint_mode_t mode,
+                              const int num_points,
+                              const double grid_x_bohr[],
+                              const double grid_y_bohr[],
+                              const double grid_z_bohr[],
+                              const double grid_w[],
+                              const double dmat[],
+                              double gradient[])
+{
+    if (not use_cartesian_dmat)
+    {
+        return integrate_gradient_points(mode,
+                                         num_points,
+                                         grid_x_bohr,
+                                         grid_y_bohr,
+                                         grid_z_bohr,
+                                         grid_w,
+                                         dmat,
+                                         gradient);
+    }
 
-    assert(num_dmat <= MAX_NUM_DENSITIES);
+    // as in integrate, the points see a dense Cartesian matrix
+    int cart_dim = balboa_get_num_aos(cartesian_context);
+    double *dmat_cart = new double[cart_dim * cart_dim];
+    transform_to_cartesian(dmat, dmat_cart);
+
+    MatrixLayout user_layout = matrix_layout;
+    matrix_layout.set_dense(cart_dim);
+    int ierr = integrate_gradient_points(mode,
+                                         num_points,
+                                         grid_x_bohr,
+                                         grid_y_bohr,
+                                         grid_z_bohr,
+                                         grid_w,
+                                         dmat_cart,
+                                         gradient);
+    matrix_layout = user_layout;
+
+    delete[] dmat_cart;
 
-    use_dmat[0] = true;
-    dmat_index[0] = 0;
-    for (int k = 1; k < num_dmat; k++)
+    return ierr;
+}
+
+XCINT_API
+int xcint_integrate_hessian(xcint_context_t *context,
+                            const xcint_mode_t mode,
+                            const int num_points,
+                            const double grid_x_bohr[],
+                            const double grid_y_bohr[],
+                            const double grid_z_bohr[],
+                            const double grid_w[],
+                            const int num_dmat,
+                            const double dmat[],
+                            double hessian[])
+{
+    return AS_TYPE(XCint, context)
+        ->integrate_hessian(mode,
+                            num_points,
+                            grid_x_bohr,
+                            grid_y_bohr,
+                            grid_z_bohr,
+                            grid_w,
+                            num_dmat,
+                            dmat,
+                            hessian);
+}
+int XCint::integrate_hessian(const xcint_mode_t mode,
+                             const int num_points,
+                             const double grid_x_bohr[],
+                             const double grid_y_bohr[],
+                             const double grid_z_bohr[],
+                             const double grid_w[],
+                             const int num_dmat,
+                             const double dmat[],
+                             double hessian[])
+{
+    if (num_dmat != 1 and num_dmat != 1 + 3 * num_basis_centers)
     {
-        assert(perturbation_indices[k] <= MAX_NUM_DENSITIES);
-        use_dmat[perturbation_indices[k]] = true;
-        dmat_index[perturbation_indices[k]] = k * mat_dim * mat_dim;
+        fprintf(stderr,
+                "ERROR: xcint_integrate_hessian needs 1 or 1 + 3 * "
+                "num_centers matrices, got %i\n",
+                num_dmat);
+        return -1;
     }
 
-    assert(num_perturbations < 7);
+    if (not use_cartesian_dmat)
+    {
+        return integrate_hessian_points(mode,
+                                        num_points,
+                                        grid_x_bohr,
+                                        grid_y_bohr,
+                                        grid_z_bohr,
+                                        grid_w,
+                                        num_dmat,
+                                        dmat,
+                                        hessian);
+    }
 
-#ifdef HAVE_OPENMP
-    size_t num_threads = 0;
+    // as in integrate, the points see dense Cartesian matrices
+    int mat_len = matrix_layout.get_length();
+    int cart_dim = balboa_get_num_aos(cartesian_context);
+    int cart_len = cart_dim * cart_dim;
 
-#pragma omp parallel
+    double *dmat_cart = new double[num_dmat * cart_len];
+    for (int k = 0; k < num_dmat; k++)
     {
-        if (omp_get_thread_num() == 0)
-            num_threads = omp_get_num_threads();
+        transform_to_cartesian(&dmat[k * mat_len], &dmat_cart[k * cart_len]);
     }
 
-    double *num_electrons_buffer = new double[num_threads];
-    double *exc_buffer = new double[num_threads];
-    double *vxc_buffer = new double[num_threads * mat_dim * mat_dim];
-    std::fill(
-        &vxc_buffer[0], &vxc_buffer[num_threads * mat_dim * mat_dim], 0.0);
+    MatrixLayout user_layout = matrix_layout;
+    matrix_layout.set_dense(cart_dim);
+    int ierr = integrate_hessian_points(mode,
+                                        num_points,
+                                        grid_x_bohr,
+                                        grid_y_bohr,
+                                        grid_z_bohr,
+                                        grid_w,
+                                        num_dmat,
+                                        dmat_cart,
+                                        hessian);
+    matrix_layout = user_layout;
+
+    delete[] dmat_cart;
 
-#pragma omp parallel
-    {
-        int ithread = omp_get_thread_num();
+    return ierr;
+}
 
-        double exc_local = 0.0;
-        double num_electrons_local = 0.0;
+// first AO and number of AOs of a shell
+static void get_shell_range(const balboa_context_t *context,
+                            const int ishell,
+                            int &off,
+                            int &deg)
+{
+    off = balboa_get_shell_off(context, ishell);
+    int end = balboa_get_num_aos(context);
+    if (ishell + 1 < balboa_get_num_shells(context))
+        end = balboa_get_shell_off(context, ishell + 1);
+    deg = end - off;
+}
 
-        double *vxc_local = NULL;
-        if (get_vxc)
-            vxc_local = &vxc_buffer[ithread * mat_dim * mat_dim];
-#else
-        double exc_local = *exc;
-        double num_electrons_local = *num_electrons;
-        double *vxc_local = NULL;
+// the spherical AOs of a shell are phi_s = sum_c T_cs chi_c with the
+// Cartesian AOs chi_c, so that D_cart = T D T^t and V = T^t V_cart T;
+// T is block diagonal over shells which makes both O(N^2)
+void XCint::transform_to_cartesian(const double mat[], double mat_cart[]) const
+{
+    int num_shells = balboa_get_num_shells(balboa_context);
+    int dim = balboa_get_num_aos(balboa_context);
+    int cart_dim = balboa_get_num_aos(cartesian_context);
 
-        if (get_vxc)
-            vxc_local = &vxc[0];
-#endif /* HAVE_OPENMP */
+    std::vector<double> d(dim * dim, 0.0);
+    for (int k = 0; k < dim; k++)
+    {
+        for (int l = 0; l < dim; l++)
+        {
+            int o = matrix_layout.get_offset(k, l);
+            if (o > -1)
+                d[k * dim + l] = mat[o];
+        }
+    }
 
-        auto xcfun = xcfun_new();
-        Functional fun;
-        fun.set_functional(functional_line.c_str());
-        for (size_t i = 0; i < fun.keys.size(); i++)
+    // x = D T^t
+    std::vector<double> x(dim * cart_dim, 0.0);
+    for (int ishell = 0; ishell < num_shells; ishell++)
+    {
+        int s_off, s_deg, c_off, c_deg;
+        get_shell_range(balboa_context, ishell, s_off, s_deg);
+        get_shell_range(cartesian_context, ishell, c_off, c_deg);
+        const double *t = &cs_transform[cs_transform_off[ishell]];
+        for (int k = 0; k < dim; k++)
         {
-            int ierr = xcfun_set(xcfun, fun.keys[i].c_str(), fun.weights[i]);
-            if (ierr != 0)
+            for (int c = 0; c < c_deg; c++)
             {
-                fprintf(stderr,
-                        "ERROR in fun init: \"%s\" not recognized, quitting.\n",
-                        fun.keys[i].c_str());
-                exit(-1);
+                double sum = 0.0;
+                for (int s = 0; s < s_deg; s++)
+                    sum += d[k * dim + s_off + s] * t[c * s_deg + s];
+                x[k * cart_dim + c_off + c] = sum;
             }
         }
+    }
 
-        int num_variables;
-        int max_ao_order_g;
-        max_ao_order_g = 0;
-
-        if (fun.is_tau_mgga)
+    // D_cart = T x
+    std::fill(&mat_cart[0], &mat_cart[cart_dim * cart_dim], 0.0);
+    for (int ishell = 0; ishell < num_shells; ishell++)
+    {
+        int s_off, s_deg, c_off, c_deg;
+        get_shell_range(balboa_context, ishell, s_off, s_deg);
+        get_shell_range(cartesian_context, ishell, c_off, c_deg);
+        const double *t = &cs_transform[cs_transform_off[ishell]];
+        for (int c = 0; c < c_deg; c++)
         {
-            num_variables = 5;
-            get_gradient = true;
-            get_tau = true;
-            max_ao_order_g++;
+            for (int s = 0; s < s_deg; s++)
+            {
+                double f = t[c * s_deg + s];
+                if (f == 0.0)
+                    continue;
+                for (int l = 0; l < cart_dim; l++)
+                    mat_cart[(c_off + c) * cart_dim + l] +=
+                        f * x[(s_off + s) * cart_dim + l];
+            }
         }
-        else if (fun.is_gga)
-        {
+    }
+}
+
+void XCint::transform_to_spherical(const double mat_cart[], double mat[]) const
+{
+    int num_shells = balboa_get_num_shells(balboa_context);
+    int dim = balboa_get_num_aos(balboa_context);
+    int cart_dim = balboa_get_num_aos(cartesian_context);
+
+    // y = V_cart T
+    std::vector<double> y(cart_dim * dim, 0.0);
+    for (int ishell = 0; ishell < num_shells; ishell++)
+    {
+        int s_off, s_deg, c_off, c_deg;
+        get_shell_range(balboa_context, ishell, s_off, s_deg);
+        get_shell_range(cartesian_context, ishell, c_off, c_deg);
+        const double *t = &cs_transform[cs_transform_off[ishell]];
+        for (int k = 0; k < cart_dim; k++)
+        {
+            for (int s = 0; s < s_deg; s++)
+            {
+                double sum = 0.0;
+                for (int c = 0; c < c_deg; c++)
+                    sum += mat_cart[k * cart_dim + c_off + c] *
+                           t[c * s_deg + s];
+                y[k * dim + s_off + s] = sum;
+            }
+        }
+    }
+
+    // V = T^t y
+    std::vector<double> v(dim * dim, 0.0);
+    for (int ishell = 0; ishell < num_shells; ishell++)
+    {
+        int s_off, s_deg, c_off, c_deg;
+        get_shell_range(balboa_context, ishell, s_off, s_deg);
+        get_shell_range(cartesian_context, ishell, c_off, c_deg);
+        const double *t = &cs_transform[cs_transform_off[ishell]];
+        for (int s = 0; s < s_deg; s++)
+        {
+            for (int c = 0; c < c_deg; c++)
+            {
+                double f = t[c * s_deg + s];
+                if (f == 0.0)
+                    continue;
+                for (int l = 0; l < dim; l++)
+                    v[(s_off + s) * dim + l] +=
+                        f * y[(c_off + c) * dim + l];
+            }
+        }
+    }
+
+    for (int k = 0; k < dim; k++)
+    {
+        for (int l = 0; l < dim; l++)
+        {
+            int o = matrix_layout.get_offset(k, l);
+            if (o > -1)
+                mat[o] = v[k * dim + l];
+        }
+    }
+}
+
+// xcfun instance for the functional in line, quits if xcfun
+// does not know one of its keys
+static xcfun_t *new_xcfun(const std::string &line, Functional &fun)
+{
+    auto xcfun = xcfun_new();
+    fun.set_functional(line.c_str());
+    for (size_t i = 0; i < fun.keys.size(); i++)
+    {
+        int ierr = xcfun_set(xcfun, fun.keys[i].c_str(), fun.weights[i]);
+        if (ierr != 0)
+        {
+            fprintf(stderr,
+                    "ERROR in fun init: \"%s\" not recognized, quitting.\n",
+                    fun.keys[i].c_str());
+            exit(-1);
+        }
+    }
+    return xcfun;
+}
+
+int XCint::integrate_points(const xcint_mode_t mode,
+                            const int num_points,
+                            const double grid_x_bohr[],
+                            const double grid_y_bohr[],
+                            const double grid_z_bohr[],
+                            const double grid_w[],
+                            const int num_perturbations,
+                            const xcint_perturbation_t perturbations[],
+                            const int components[],
+                            const int num_dmat,
+                            const int perturbation_indices[],
+                            const double dmat[],
+                            const bool get_exc,
+                            double *exc,
+                            const bool get_vxc,
+                            double vxc[],
+                            //  double *num_electrons) const
+                            double *num_electrons)
+{
+    assert(mode == XCINT_MODE_RKS);
+
+    std::vector<int> coor;
+
+    int mat_dim = balboa_get_num_aos(ao_context);
+    int mat_len = matrix_layout.get_length();
+
+    int geo_derv_order = 0;
+    int num_fields = 0;
+    for (int i = 0; i < num_perturbations; i++)
+    {
+        if (perturbations[i] == XCINT_PERT_GEO)
+            geo_derv_order++;
+        if (perturbations[i] == XCINT_PERT_EL)
+            num_fields++;
+    }
+
+    int *geo_coor = NULL;
+    if (geo_derv_order > 0)
+    {
+        geo_coor = new int[geo_derv_order];
+        for (int i = 0; i < num_perturbations; i++)
+        {
+            if (perturbations[i] == XCINT_PERT_GEO)
+                geo_coor[i] = components[2 * i]; // FIXME
+        }
+    }
+
+    *exc = 0.0;
+    *num_electrons = 0.0;
+
+    if (get_vxc)
+        std::fill(&vxc[0], &vxc[mat_len], 0.0);
+
+    bool get_gradient;
+    bool get_tau;
+
+    int *dmat_index = new int[MAX_NUM_DENSITIES];
+    std::fill(&dmat_index[0], &dmat_index[MAX_NUM_DENSITIES], 0);
+
+    bool *use_dmat = new bool[MAX_NUM_DENSITIES];
+    std::fill(&use_dmat[0], &use_dmat[MAX_NUM_DENSITIES], false);
+
+    assert(num_dmat <= MAX_NUM_DENSITIES);
+
+    use_dmat[0] = true;
+    dmat_index[0] = 0;
+    for (int k = 1; k < num_dmat; k++)
+    {
+        assert(perturbation_indices[k] <= MAX_NUM_DENSITIES);
+        use_dmat[perturbation_indices[k]] = true;
+        dmat_index[perturbation_indices[k]] = k * mat_len;
+    }
+
+    assert(num_perturbations < 7);
+
+    // classified once here and not per batch
+    dmat_symmetry.resize(num_dmat);
+    for (int k = 0; k < num_dmat; k++)
+    {
+        dmat_symmetry[k] = matrix_layout.get_symmetry(&dmat[k * mat_len]);
+    }
+
+    // a failing batch does not stop the others, the error is returned
+    // at the end
+    int ierr = 0;
+
+#ifdef HAVE_OPENMP
+    size_t num_threads = 0;
+
+#pragma omp parallel
+    {
+        if (omp_get_thread_num() == 0)
+            num_threads = omp_get_num_threads();
+    }
+
+    double *num_electrons_buffer = new double[num_threads];
+    double *exc_buffer = new double[num_threads];
+    double *vxc_buffer = new double[num_threads * mat_len];
+    std::fill(
+        &vxc_buffer[0], &vxc_buffer[num_threads * mat_len], 0.0);
+
+#pragma omp parallel
+    {
+        int ithread = omp_get_thread_num();
+
+        double exc_local = 0.0;
+        double num_electrons_local = 0.0;
+
+        double *vxc_local = NULL;
+        if (get_vxc)
+            vxc_local = &vxc_buffer[ithread * mat_len];
+#else
+        double exc_local = *exc;
+        double num_electrons_local = *num_electrons;
+        double *vxc_local = NULL;
+
+        if (get_vxc)
+            vxc_local = &vxc[0];
+#endif /* HAVE_OPENMP */
+
+        Functional fun;
+        auto xcfun = new_xcfun(functional_line, fun);
+
+        int num_variables;
+        int max_ao_order_g;
+        max_ao_order_g = 0;
+
+        if (fun.is_tau_mgga)
+        {
+            num_variables = 5;
+            get_gradient = true;
+            get_tau = true;
+            max_ao_order_g++;
+        }
+        else if (fun.is_gga)
+        {
+            num_variables = 4;
+            get_gradient = true;
+            get_tau = false;
+            max_ao_order_g++;
+        }
+        else
+        {
+            num_variables = 1;
+            get_gradient = false;
+            get_tau = false;
+        }
+
+        for (int i = 0; i < geo_derv_order; i++)
+        {
+            max_ao_order_g++;
+        }
+
+        // AO scratch memory of this thread, reused by all its batches
+        balboa_workspace_t *workspace =
+            balboa_new_workspace(ao_context, max_ao_order_g);
+
+	// first we integrate the number of points
+	// divisible by AO_BLOCK_LENGTH
+        int block_length = AO_BLOCK_LENGTH;
+        int num_batches = num_points / AO_BLOCK_LENGTH;
+#ifdef HAVE_OPENMP
+#pragma omp for schedule(dynamic) reduction(min : ierr)
+#endif
+        for (int ibatch = 0; ibatch < num_batches; ibatch++)
+        {
+            int ipoint = ibatch * AO_BLOCK_LENGTH;
+
+            int ierr_batch =
+                integrate_batch(workspace,
+                                dmat,
+                                xcfun,
+                                &fun,
+                                get_exc,
+                                exc_local,
+                                get_vxc,
+                                vxc_local,
+                                num_electrons_local,
+                                geo_coor,
+                                use_dmat,
+                                num_dmat,
+                                perturbation_indices,
+                                ipoint,
+                                geo_derv_order,
+                                max_ao_order_g,
+                                block_length,
+                                num_variables,
+                                num_perturbations,
+                                num_fields,
+                                mat_dim,
+                                get_gradient,
+                                get_tau,
+                                dmat_index,
+                                grid_x_bohr,
+                                grid_y_bohr,
+                                grid_z_bohr,
+                                grid_w);
+            ierr = std::min(ierr, ierr_batch);
+        }
+
+	// if some points are left, we integreate
+	// them only on one thread
+#ifdef HAVE_OPENMP
+#pragma omp single
+#endif
+        if (num_points % AO_BLOCK_LENGTH != 0)
+	{
+            int ipoint = num_batches * AO_BLOCK_LENGTH;
+            int block_length = num_points - AO_BLOCK_LENGTH * num_batches;
+
+            int ierr_batch =
+                integrate_batch(workspace,
+                                dmat,
+                                xcfun,
+                                &fun,
+                                get_exc,
+                                exc_local,
+                                get_vxc,
+                                vxc_local,
+                                num_electrons_local,
+                                geo_coor,
+                                use_dmat,
+                                num_dmat,
+                                perturbation_indices,
+                                ipoint,
+                                geo_derv_order,
+                                max_ao_order_g,
+                                block_length,
+                                num_variables,
+                                num_perturbations,
+                                num_fields,
+                                mat_dim,
+                                get_gradient,
+                                get_tau,
+                                dmat_index,
+                                grid_x_bohr,
+                                grid_y_bohr,
+                                grid_z_bohr,
+                                grid_w);
+            ierr = std::min(ierr, ierr_batch);
+	}
+
+        balboa_free_workspace(workspace);
+
+#ifdef HAVE_OPENMP
+        if (get_exc)
+            exc_buffer[ithread] = exc_local;
+        num_electrons_buffer[ithread] = num_electrons_local;
+    }
+
+    for (size_t ithread = 0; ithread < num_threads; ithread++)
+    {
+        *num_electrons += num_electrons_buffer[ithread];
+        if (get_exc)
+            *exc += exc_buffer[ithread];
+        if (get_vxc)
+        {
+	    // FIXME consider using blas daxpy for this
+            for (int i = 0; i < mat_len; i++)
+            {
+                vxc[i] += vxc_buffer[ithread * mat_len + i];
+            }
+        }
+    }
+
+    delete[] num_electrons_buffer;
+    delete[] exc_buffer;
+    delete[] vxc_buffer;
+#else
+    *exc = exc_local;
+    *num_electrons = num_electrons_local;
+#endif /* HAVE_OPENMP */
+
+    delete[] use_dmat;
+    delete[] dmat_index;
+    delete[] geo_coor;
+
+    // contributions where k and l AOs match are accumulated
+    // symmetrically already, only geometric derivatives are not
+    if (get_vxc && geo_derv_order > 0)
+    {
+        // symmetrize result matrix
+        matrix_layout.symmetrize(vxc);
+    }
+
+    return ierr;
+}
+
+int XCint::get_derv_centers(const int ao_centers[],
+                            bool center_is_used[],
+                            std::vector<int> &derv_centers) const
+{
+    int num_aos = balboa_get_num_aos(ao_context);
+    std::vector<int> center_num_aos(num_basis_centers, 0);
+    for (int i = 0; i < num_aos; i++)
+    {
+        center_num_aos[ao_centers[i]]++;
+    }
+
+    // leaving out the center with the most AOs saves the most work
+    int skipped_center = 0;
+    for (int c = 1; c < num_basis_centers; c++)
+    {
+        if (center_num_aos[c] > center_num_aos[skipped_center])
+            skipped_center = c;
+    }
+
+    derv_centers.clear();
+    for (int c = 0; c < num_basis_centers; c++)
+    {
+        center_is_used[c] = (c != skipped_center and center_num_aos[c] > 0);
+        if (center_is_used[c])
+            derv_centers.push_back(c);
+    }
+
+    return skipped_center;
+}
+
+int XCint::integrate_gradient_points(const xcint_mode_t mode,
+                                     const int num_points,
+                                     const double grid_x_bohr[],
+                                     const double grid_y_bohr[],
+                                     const double grid_z_bohr[],
+                                     const double grid_w[],
+                                     const double dmat[],
+                                     double gradient[])
+{
+    assert(mode == XCINT_MODE_RKS);
+
+    int num_aos = balboa_get_num_aos(ao_context);
+    int num_shells = balboa_get_num_shells(ao_context);
+    int num_gradient = 3 * num_basis_centers;
+
+    std::fill(&gradient[0], &gradient[num_gradient], 0.0);
+
+    bool dmat_is_symmetric =
+        (matrix_layout.get_symmetry(dmat) == MATRIX_SYMMETRIC);
+
+    int *ao_centers = new int[num_aos];
+    for (int i = 0; i < num_aos; i++)
+    {
+        ao_centers[i] = balboa_get_ao_center(ao_context, i);
+    }
+    int *shell_off = new int[num_shells];
+    for (int i = 0; i < num_shells; i++)
+    {
+        shell_off[i] = balboa_get_shell_off(ao_context, i);
+    }
+
+    // the gradient sums to zero by translational invariance, so one
+    // center is left out of the grid pass and obtained from the others
+    bool *center_is_used = new bool[num_basis_centers];
+    std::vector<int> derv_centers;
+    int skipped_center =
+        get_derv_centers(ao_centers, center_is_used, derv_centers);
+
+    // a failing batch does not stop the others, the error is returned
+    // at the end
+    int ierr = 0;
+
+#ifdef HAVE_OPENMP
+    size_t num_threads = 0;
+
+#pragma omp parallel
+    {
+        if (omp_get_thread_num() == 0)
+            num_threads = omp_get_num_threads();
+    }
+
+    double *gradient_buffer = new double[num_threads * num_gradient];
+    std::fill(&gradient_buffer[0],
+              &gradient_buffer[num_threads * num_gradient],
+              0.0);
+
+#pragma omp parallel
+    {
+        int ithread = omp_get_thread_num();
+
+        double *gradient_local = &gradient_buffer[ithread * num_gradient];
+#else
+        double *gradient_local = &gradient[0];
+#endif /* HAVE_OPENMP */
+
+        Functional fun;
+        auto xcfun = new_xcfun(functional_line, fun);
+
+        int num_variables = 1;
+        if (fun.is_gga)
+            num_variables = 4;
+        if (fun.is_tau_mgga)
+            num_variables = 5;
+        bool get_gradient = (num_variables > 1);
+        bool get_tau = (num_variables == 5);
+
+        // one order more than the functional for the derivative slices
+        int max_ao_order_g = 1;
+        if (get_gradient)
+            max_ao_order_g++;
+
+        balboa_workspace_t *workspace =
+            balboa_new_workspace(ao_context, max_ao_order_g);
+
+        int num_batches = (num_points + AO_BLOCK_LENGTH - 1) / AO_BLOCK_LENGTH;
+#ifdef HAVE_OPENMP
+#pragma omp for schedule(dynamic) reduction(min : ierr)
+#endif
+        for (int ibatch = 0; ibatch < num_batches; ibatch++)
+        {
+            int ipoint = ibatch * AO_BLOCK_LENGTH;
+            int block_length =
+                std::min(AO_BLOCK_LENGTH, num_points - ipoint);
+
+            int ierr_batch =
+                integrate_gradient_batch(workspace,
+                                         dmat,
+                                         dmat_is_symmetric,
+                                         xcfun,
+                                         &fun,
+                                         ipoint,
+                                         block_length,
+                                         num_variables,
+                                         max_ao_order_g,
+                                         get_gradient,
+                                         get_tau,
+                                         ao_centers,
+                                         num_shells,
+                                         shell_off,
+                                         (int)derv_centers.size(),
+                                         derv_centers.data(),
+                                         center_is_used,
+                                         grid_x_bohr,
+                                         grid_y_bohr,
+                                         grid_z_bohr,
+                                         grid_w,
+                                         gradient_local);
+            ierr = std::min(ierr, ierr_batch);
+        }
+
+        balboa_free_workspace(workspace);
+        xcfun_delete(xcfun);
+
+#ifdef HAVE_OPENMP
+    }
+
+    for (size_t ithread = 0; ithread < num_threads; ithread++)
+    {
+        for (int i = 0; i < num_gradient; i++)
+        {
+            gradient[i] += gradient_buffer[ithread * num_gradient + i];
+        }
+    }
+
+    delete[] gradient_buffer;
+#endif /* HAVE_OPENMP */
+
+    for (int c = 0; c < num_basis_centers; c++)
+    {
+        if (center_is_used[c])
+        {
+            for (int a = 0; a < 3; a++)
+            {
+                gradient[3 * skipped_center + a] -= gradient[3 * c + a];
+            }
+        }
+    }
+
+    delete[] ao_centers;
+    delete[] shell_off;
+    delete[] center_is_used;
+
+    return ierr;
+}
+
+int XCint::integrate_gradient_batch(balboa_workspace_t *workspace,
+                                    const double dmat[],
+                                    const bool dmat_is_symmetric,
+                                          xcfun_t *xcfun,
+                                          Functional *fun,
+                                    const int ipoint,
+                                    const int block_length,
+                                    const int num_variables,
+                                    const int max_ao_order_g,
+                                    const bool get_gradient,
+                                    const bool get_tau,
+                                    const int ao_centers[],
+                                    const int num_shells,
+                                    const int shell_off[],
+                                    const int num_derv_centers,
+                                    const int derv_centers[],
+                                    const bool center_is_used[],
+                                    const double grid_x_bohr[],
+                                    const double grid_y_bohr[],
+                                    const double grid_z_bohr[],
+                                    const double grid_w[],
+                                    double gradient[])
+{
+    int mat_dim = balboa_get_num_aos(ao_context);
+
+    double *n = new double[AO_BLOCK_LENGTH * num_variables];
+    double *u = new double[AO_BLOCK_LENGTH * num_variables];
+    double prefactors[5] = {1.0, 2.0, 2.0, 2.0, 0.5};
+
+    bool n_is_used[MAX_NUM_DENSITIES];
+    std::fill(&n_is_used[0], &n_is_used[MAX_NUM_DENSITIES], false);
+    n_is_used[0] = true;
+
+    // the energy is not needed here
+    double exc = 0.0;
+
+    int buffer_len =
+        balboa_get_buffer_len(ao_context, max_ao_order_g, AO_BLOCK_LENGTH);
+
+    // derivative slices only for AOs on the centers of the pass,
+    // all others are needed for the density only
+    double *ao = new double[buffer_len];
+    int ierr = balboa_get_ao_on_centers(ao_context,
+                                        workspace,
+                                        max_ao_order_g,
+                                        max_ao_order_g - 1,
+                                        num_derv_centers,
+                                        derv_centers,
+                                        block_length,
+                                        &grid_x_bohr[ipoint],
+                                        &grid_y_bohr[ipoint],
+                                        &grid_z_bohr[ipoint],
+                                        ao);
+    if (ierr != 0)
+    {
+        delete[] n;
+        delete[] u;
+        delete[] ao;
+        return ierr;
+    }
+
+    double *ao_compressed = new double[buffer_len];
+    int *ao_compressed_index = new int[buffer_len];
+    int ao_compressed_num;
+    int slice_offsets[4];
+    auto get_geo_offset = [&](int i, int j, int k) {
+        return balboa_get_geo_offset(ao_context, i, j, k);
+    };
+
+    compute_slice_offsets(std::vector<int>(), slice_offsets);
+    compress(get_gradient,
+             block_length,
+             ao_compressed_num,
+             ao_compressed_index,
+             ao_compressed,
+             NULL,
+             mat_dim,
+             ao,
+             ao_centers,
+             num_shells,
+             shell_off,
+             std::vector<int>(),
+             slice_offsets);
+
+    std::fill(&n[0], &n[block_length * num_variables], 0.0);
+    get_density(mat_dim,
+                matrix_layout,
+                block_length,
+                get_gradient,
+                get_tau,
+                prefactors,
+                n,
+                dmat,
+                dmat_is_symmetric,
+                true,
+                ao_compressed_num,
+                ao_compressed_index,
+                ao_compressed,
+                ao_compressed_num,
+                ao_compressed_index,
+                ao_compressed,
+                NULL);
+
+    get_xc_potential(block_length,
+                     num_variables,
+                     0,
+                     xcfun,
+                     fun,
+                     ipoint,
+                     n_is_used,
+                     n,
+                     u,
+                     exc,
+                     grid_w);
+
+    add_geo_gradient(matrix_layout,
+                     block_length,
+                     get_gradient,
+                     get_tau,
+                     u,
+                     dmat,
+                     dmat_is_symmetric,
+                     ao_compressed_num,
+                     ao_compressed_index,
+                     ao_compressed,
+                     ao,
+                     ao_centers,
+                     center_is_used,
+                     get_geo_offset,
+                     gradient);
+
+    delete[] n;
+    delete[] u;
+    delete[] ao;
+    delete[] ao_compressed;
+    delete[] ao_compressed_index;
+
+    return 0;
+}
+
+int XCint::integrate_hessian_points(const xcint_mode_t mode,
+                                    const int num_points,
+                                    const double grid_x_bohr[],
+                                    const double grid_y_bohr[],
+                                    const double grid_z_bohr[],
+                                    const double grid_w[],
+                                    const int num_dmat,
+                                    const double dmat[],
+                                    double hessian[])
+{
+    assert(mode == XCINT_MODE_RKS);
+
+    int num_aos = balboa_get_num_aos(ao_context);
+    int num_shells = balboa_get_num_shells(ao_context);
+    int mat_len = matrix_layout.get_length();
+    int num_coor = 3 * num_basis_centers;
+    int num_hessian = num_coor * num_coor;
+
+    // the derivatives of dmat, one per coordinate
+    int num_rmat = num_dmat - 1;
+    const double *rmat = &dmat[mat_len];
+    int num_response = num_coor * num_rmat;
+
+    std::fill(&hessian[0], &hessian[num_hessian], 0.0);
+    double *response = new double[num_response];
+    std::fill(&response[0], &response[num_response], 0.0);
+
+    bool dmat_is_symmetric =
+        (matrix_layout.get_symmetry(dmat) == MATRIX_SYMMETRIC);
+
+    int *ao_centers = new int[num_aos];
+    for (int i = 0; i < num_aos; i++)
+    {
+        ao_centers[i] = balboa_get_ao_center(ao_context, i);
+    }
+    int *shell_off = new int[num_shells];
+    for (int i = 0; i < num_shells; i++)
+    {
+        shell_off[i] = balboa_get_shell_off(ao_context, i);
+    }
+
+    // as for the gradient, rows and columns of one center are
+    // obtained from the others at the end
+    bool *center_is_used = new bool[num_basis_centers];
+    std::vector<int> derv_centers;
+    int skipped_center =
+        get_derv_centers(ao_centers, center_is_used, derv_centers);
+
+    // a failing batch does not stop the others, the error is returned
+    // at the end
+    int ierr = 0;
+
+#ifdef HAVE_OPENMP
+    size_t num_threads = 0;
+
+#pragma omp parallel
+    {
+        if (omp_get_thread_num() == 0)
+            num_threads = omp_get_num_threads();
+    }
+
+    double *hessian_buffer = new double[num_threads * num_hessian];
+    std::fill(&hessian_buffer[0],
+              &hessian_buffer[num_threads * num_hessian],
+              0.0);
+    double *response_buffer = new double[num_threads * num_response];
+    std::fill(&response_buffer[0],
+              &response_buffer[num_threads * num_response],
+              0.0);
+
+#pragma omp parallel
+    {
+        int ithread = omp_get_thread_num();
+
+        double *hessian_local = &hessian_buffer[ithread * num_hessian];
+        double *response_local = &response_buffer[ithread * num_response];
+#else
+        double *hessian_local = &hessian[0];
+        double *response_local = &response[0];
+#endif /* HAVE_OPENMP */
+
+        Functional fun;
+        auto xcfun = new_xcfun(functional_line, fun);
+
+        int num_variables = 1;
+        if (fun.is_gga)
             num_variables = 4;
-            get_gradient = true;
-            get_tau = false;
-            max_ao_order_g++;
-        }
-        else
-        {
-            num_variables = 1;
-            get_gradient = false;
-            get_tau = false;
-        }
+        if (fun.is_tau_mgga)
+            num_variables = 5;
+        bool get_gradient = (num_variables > 1);
+        bool get_tau = (num_variables == 5);
 
-        for (int i = 0; i < geo_derv_order; i++)
-        {
+        // two orders more than the functional for the derivative slices
+        int max_ao_order_g = 2;
+        if (get_gradient)
             max_ao_order_g++;
-        }
 
-	// first we integrate the number of points
-	// divisible by AO_BLOCK_LENGTH
-        int block_length = AO_BLOCK_LENGTH;
-        int num_batches = num_points / AO_BLOCK_LENGTH;
+        balboa_workspace_t *workspace =
+            balboa_new_workspace(ao_context, max_ao_order_g);
+
+        int num_batches = (num_points + AO_BLOCK_LENGTH - 1) / AO_BLOCK_LENGTH;
 #ifdef HAVE_OPENMP
-#pragma omp for schedule(dynamic)
+#pragma omp for schedule(dynamic) reduction(min : ierr)
 #endif
         for (int ibatch = 0; ibatch < num_batches; ibatch++)
         {
             int ipoint = ibatch * AO_BLOCK_LENGTH;
-
-            integrate_batch(dmat,
-                            xcfun,
-                            &fun,
-                            get_exc,
-                            exc_local,
-                            get_vxc,
-                            vxc_local,
-                            num_electrons_local,
-                            geo_coor,
-                            use_dmat,
-                            num_dmat,
-                            perturbation_indices,
-                            ipoint,
-                            geo_derv_order,
-                            max_ao_order_g,
-                            block_length,
-                            num_variables,
-                            num_perturbations,
-                            num_fields,
-                            mat_dim,
-                            get_gradient,
-                            get_tau,
-                            dmat_index,
-                            grid_x_bohr,
-                            grid_y_bohr,
-                            grid_z_bohr,
-                            grid_w);
+            int block_length =
+                std::min(AO_BLOCK_LENGTH, num_points - ipoint);
+
+            int ierr_batch =
+                integrate_hessian_batch(workspace,
+                                        dmat,
+                                        dmat_is_symmetric,
+                                        num_rmat,
+                                        rmat,
+                                        xcfun,
+                                        &fun,
+                                        ipoint,
+                                        block_length,
+                                        num_variables,
+                                        max_ao_order_g,
+                                        get_gradient,
+                                        get_tau,
+                                        ao_centers,
+                                        num_shells,
+                                        shell_off,
+                                        (int)derv_centers.size(),
+                                        derv_centers.data(),
+                                        center_is_used,
+                                        grid_x_bohr,
+                                        grid_y_bohr,
+                                        grid_z_bohr,
+                                        grid_w,
+                                        hessian_local,
+                                        response_local);
+            ierr = std::min(ierr, ierr_batch);
         }
 
-	// if some points are left, we integreate
-	// them only on one thread
-#ifdef HAVE_OPENMP
-#pragma omp single
-#endif
-        if (num_points % AO_BLOCK_LENGTH != 0)
-	{
-            int ipoint = num_batches * AO_BLOCK_LENGTH;
-            int block_length = num_points - AO_BLOCK_LENGTH * num_batches;
-
-            integrate_batch(dmat,
-                            xcfun,
-                            &fun,
-                            get_exc,
-                            exc_local,
-                            get_vxc,
-                            vxc_local,
-                            num_electrons_local,
-                            geo_coor,
-                            use_dmat,
-                            num_dmat,
-                            perturbation_indices,
-                            ipoint,
-                            geo_derv_order,
-                            max_ao_order_g,
-                            block_length,
-                            num_variables,
-                            num_perturbations,
-                            num_fields,
-                            mat_dim,
-                            get_gradient,
-                            get_tau,
-                            dmat_index,
-                            grid_x_bohr,
-                            grid_y_bohr,
-                            grid_z_bohr,
-                            grid_w);
-	}
+        balboa_free_workspace(workspace);
+        xcfun_delete(xcfun);
 
 #ifdef HAVE_OPENMP
-        if (get_exc)
-            exc_buffer[ithread] = exc_local;
-        num_electrons_buffer[ithread] = num_electrons_local;
     }
 
     for (size_t ithread = 0; ithread < num_threads; ithread++)
     {
-        *num_electrons += num_electrons_buffer[ithread];
-        if (get_exc)
-            *exc += exc_buffer[ithread];
-        if (get_vxc)
+        for (int i = 0; i < num_hessian; i++)
         {
-	    // FIXME consider using blas daxpy for this
-            for (int i = 0; i < mat_dim * mat_dim; i++)
-            {
-                vxc[i] += vxc_buffer[ithread * mat_dim * mat_dim + i];
-            }
+            hessian[i] += hessian_buffer[ithread * num_hessian + i];
+        }
+        for (int i = 0; i < num_response; i++)
+        {
+            response[i] += response_buffer[ithread * num_response + i];
         }
     }
 
-    delete[] num_electrons_buffer;
-    delete[] exc_buffer;
-    delete[] vxc_buffer;
-#else
-    *exc = exc_local;
-    *num_electrons = num_electrons_local;
+    delete[] hessian_buffer;
+    delete[] response_buffer;
 #endif /* HAVE_OPENMP */
 
-    delete[] use_dmat;
-    delete[] dmat_index;
-    delete[] geo_coor;
-
-    if (get_vxc)
+    // the part at fixed dmat is symmetric and both its rows and columns
+    // sum to zero, the response only differentiates the gradient so
+    // only its rows do
+    for (int a = 0; a < 3; a++)
     {
-        // symmetrize result matrix
-        for (int k = 0; k < mat_dim; k++)
+        int ia = 3 * skipped_center + a;
+        for (size_t i = 0; i < derv_centers.size(); i++)
+        {
+            for (int j = 0; j < num_coor; j++)
+            {
+                int ic = 3 * derv_centers[i] + a;
+                hessian[j * num_coor + ia] -= hessian[j * num_coor + ic];
+            }
+        }
+    }
+    for (int a = 0; a < 3; a++)
+    {
+        int ia = 3 * skipped_center + a;
+        for (size_t i = 0; i < derv_centers.size(); i++)
         {
-            for (int l = 0; l < k; l++)
+            int ic = 3 * derv_centers[i] + a;
+            for (int j = 0; j < num_coor; j++)
             {
-                double a = vxc[k * mat_dim + l] + vxc[l * mat_dim + k];
-                vxc[k * mat_dim + l] = 0.5 * a;
-                vxc[l * mat_dim + k] = 0.5 * a;
+                hessian[ia * num_coor + j] -= hessian[ic * num_coor + j];
+                if (num_rmat > 0)
+                    response[ia * num_rmat + j] -= response[ic * num_rmat + j];
             }
         }
     }
+    for (int i = 0; i < num_response; i++)
+    {
+        hessian[i] += response[i];
+    }
+
+    delete[] response;
+    delete[] ao_centers;
+    delete[] shell_off;
+    delete[] center_is_used;
+
+    return ierr;
+}
+
+int XCint::integrate_hessian_batch(balboa_workspace_t *workspace,
+                                   const double dmat[],
+                                   const bool dmat_is_symmetric,
+                                   const int num_rmat,
+                                   const double rmat[],
+                                         xcfun_t *xcfun,
+                                         Functional *fun,
+                                   const int ipoint,
+                                   const int block_length,
+                                   const int num_variables,
+                                   const int max_ao_order_g,
+                                   const bool get_gradient,
+                                   const bool get_tau,
+                                   const int ao_centers[],
+                                   const int num_shells,
+                                   const int shell_off[],
+                                   const int num_derv_centers,
+                                   const int derv_centers[],
+                                   const bool center_is_used[],
+                                   const double grid_x_bohr[],
+                                   const double grid_y_bohr[],
+                                   const double grid_z_bohr[],
+                                   const double grid_w[],
+                                   double hessian[],
+                                   double response[])
+{
+    int mat_dim = balboa_get_num_aos(ao_context);
+
+    double *n = new double[AO_BLOCK_LENGTH * num_variables];
+    double *u = new double[AO_BLOCK_LENGTH * num_variables];
+    double *f2 = new double[AO_BLOCK_LENGTH * num_variables * num_variables];
+    double prefactors[5] = {1.0, 2.0, 2.0, 2.0, 0.5};
+
+    int buffer_len =
+        balboa_get_buffer_len(ao_context, max_ao_order_g, AO_BLOCK_LENGTH);
+
+    // derivative slices only for AOs on the centers of the pass,
+    // all others are needed for the density only
+    double *ao = new double[buffer_len];
+    int ierr = balboa_get_ao_on_centers(ao_context,
+                                        workspace,
+                                        max_ao_order_g,
+                                        max_ao_order_g - 2,
+                                        num_derv_centers,
+                                        derv_centers,
+                                        block_length,
+                                        &grid_x_bohr[ipoint],
+                                        &grid_y_bohr[ipoint],
+                                        &grid_z_bohr[ipoint],
+                                        ao);
+    if (ierr != 0)
+    {
+        delete[] n;
+        delete[] u;
+        delete[] f2;
+        delete[] ao;
+        return ierr;
+    }
+
+    double *ao_compressed = new double[buffer_len];
+    int *ao_compressed_index = new int[buffer_len];
+    int ao_compressed_num;
+    int slice_offsets[4];
+    auto get_geo_offset = [&](int i, int j, int k) {
+        return balboa_get_geo_offset(ao_context, i, j, k);
+    };
+
+    compute_slice_offsets(std::vector<int>(), slice_offsets);
+    compress(get_gradient,
+             block_length,
+             ao_compressed_num,
+             ao_compressed_index,
+             ao_compressed,
+             NULL,
+             mat_dim,
+             ao,
+             ao_centers,
+             num_shells,
+             shell_off,
+             std::vector<int>(),
+             slice_offsets);
+
+    std::fill(&n[0], &n[block_length * num_variables], 0.0);
+    get_density(mat_dim,
+                matrix_layout,
+                block_length,
+                get_gradient,
+                get_tau,
+                prefactors,
+                n,
+                dmat,
+                dmat_is_symmetric,
+                true,
+                ao_compressed_num,
+                ao_compressed_index,
+                ao_compressed,
+                ao_compressed_num,
+                ao_compressed_index,
+                ao_compressed,
+                NULL);
+
+    get_xc_derivatives(
+        block_length, num_variables, xcfun, fun, ipoint, n, u, f2, grid_w);
+
+    add_geo_hessian(matrix_layout,
+                    block_length,
+                    get_gradient,
+                    get_tau,
+                    u,
+                    f2,
+                    dmat,
+                    dmat_is_symmetric,
+                    num_rmat,
+                    rmat,
+                    ao_compressed_num,
+                    ao_compressed_index,
+                    ao_compressed,
+                    ao,
+                    ao_centers,
+                    num_basis_centers,
+                    center_is_used,
+                    get_geo_offset,
+                    hessian,
+                    response);
+
+    delete[] n;
+    delete[] u;
+    delete[] f2;
+    delete[] ao;
+    delete[] ao_compressed;
+    delete[] ao_compressed_index;
 
     return 0;
 }
 
-void XCint::distribute_matrix2(const int block_length,
-                               const int num_variables,
-                               const int num_perturbations,
-                               const int mat_dim,
-                                     xcfun_t *xcfun,
-                                     Functional *fun,
-                               const double ao[],
-                               const double prefactors[],
-                               const int w_off,
-                               const bool n_is_used[],
-                               const double n[],
-                               double u[],
-                               double vxc[],
-                               double &exc,
-                               const std::vector<int> coor,
-                               const double grid_w[])
-//   const double grid_w[]) const
+void XCint::get_xc_potential(const int block_length,
+                             const int num_variables,
+                             const int num_perturbations,
+                                   xcfun_t *xcfun,
+                                   Functional *fun,
+                             const int w_off,
+                             const bool n_is_used[],
+                             const double n[],
+                             double u[],
+                             double &exc,
+                             const double grid_w[])
 {
     int off;
 
@@ -1313,6 +2496,96 @@ void XCint::distribute_matrix2(const int block_length,
         }
     }
 
+    for (int ib = 0; ib < block_length; ib++)
+    {
+        exc += xcout[ib * dens_offset] * grid_w[w_off + ib];
+    }
+
+    delete[] xcin;
+    delete[] xcout;
+}
+
+void XCint::get_xc_derivatives(const int block_length,
+                               const int num_variables,
+                                     xcfun_t *xcfun,
+                                     Functional *fun,
+                               const int w_off,
+                               const double n[],
+                               double u[],
+                               double f2[],
+                               const double grid_w[])
+{
+    // second order with the unit vectors s and t as the two
+    // perturbations gives df/dvar_s in out[1] and d2f/dvar_s dvar_t
+    // in out[3]
+    int dens_offset = fun->set_order(2, xcfun);
+
+    double *xcin = new double[num_variables * dens_offset];
+    double *xcout = new double[dens_offset];
+
+    std::fill(&u[0], &u[block_length * num_variables], 0.0);
+    std::fill(&f2[0], &f2[block_length * num_variables * num_variables], 0.0);
+
+    for (int ib = 0; ib < block_length; ib++)
+    {
+        double w = grid_w[w_off + ib];
+        if (n[ib] <= 1.0e-14 or std::abs(w) <= 1.0e-30)
+            continue;
+
+        for (int s = 0; s < num_variables; s++)
+        {
+            for (int t = s; t < num_variables; t++)
+            {
+                std::fill(&xcin[0], &xcin[num_variables * dens_offset], 0.0);
+                for (int ivar = 0; ivar < num_variables; ivar++)
+                {
+                    xcin[ivar * dens_offset] = n[ivar * block_length + ib];
+                }
+                xcin[s * dens_offset + 1] = 1.0;
+                xcin[t * dens_offset + 2] = 1.0;
+                xcfun_eval(xcfun, xcin, xcout);
+                if (t == s)
+                    u[s * block_length + ib] = w * xcout[1];
+                f2[(s * num_variables + t) * block_length + ib] = w * xcout[3];
+                f2[(t * num_variables + s) * block_length + ib] = w * xcout[3];
+            }
+        }
+    }
+
+    delete[] xcin;
+    delete[] xcout;
+}
+
+void XCint::distribute_matrix2(const int block_length,
+                               const int num_variables,
+                               const int num_perturbations,
+                               const int mat_dim,
+                                     xcfun_t *xcfun,
+                                     Functional *fun,
+                               const double ao[],
+                               const double prefactors[],
+                               const int w_off,
+                               const bool n_is_used[],
+                               const double n[],
+                               double u[],
+                               double vxc[],
+                               double &exc,
+                               const std::vector<int> coor,
+                               const double grid_w[])
+//   const double grid_w[]) const
+{
+    get_xc_potential(block_length,
+                     num_variables,
+                     num_perturbations,
+                     xcfun,
+                     fun,
+                     w_off,
+                     n_is_used,
+                     n,
+                     u,
+                     exc,
+                     grid_w);
+
     bool distribute_gradient;
     bool distribute_tau;
 
@@ -1337,15 +2610,24 @@ void XCint::distribute_matrix2(const int block_length,
         // FIXME can be moved one layer up since we need it also for density
         int max_ao_geo_order = 5; // FIXME hardcoded
         int buffer_len = balboa_get_buffer_len(
-            balboa_context, max_ao_geo_order, AO_BLOCK_LENGTH);
+            ao_context, max_ao_geo_order, AO_BLOCK_LENGTH);
         double *ao_compressed = new double[buffer_len];
+        float *ao_compressed_single = NULL;
+        if (use_mixed_precision)
+            ao_compressed_single = new float[buffer_len];
         int *ao_compressed_index = new int[buffer_len];
         int ao_compressed_num;
-        int num_aos = balboa_get_num_aos(balboa_context);
+        int num_aos = balboa_get_num_aos(ao_context);
         int *ao_centers = new int[num_aos];
         for (int i = 0; i < num_aos; i++)
         {
-            ao_centers[i] = balboa_get_ao_center(balboa_context, i);
+            ao_centers[i] = balboa_get_ao_center(ao_context, i);
+        }
+        int num_shells = balboa_get_num_shells(ao_context);
+        int *shell_off = new int[num_shells];
+        for (int i = 0; i < num_shells; i++)
+        {
+            shell_off[i] = balboa_get_shell_off(ao_context, i);
         }
         int slice_offsets[4];
         compute_slice_offsets(std::vector<int>(), slice_offsets);
@@ -1354,43 +2636,52 @@ void XCint::distribute_matrix2(const int block_length,
                  ao_compressed_num,
                  ao_compressed_index,
                  ao_compressed,
+                 ao_compressed_single,
                  num_aos,
                  ao,
                  ao_centers,
+                 num_shells,
+                 shell_off,
                  std::vector<int>(),
                  slice_offsets);
         distribute_matrix(mat_dim,
+                          matrix_layout,
                           block_length,
                           distribute_gradient,
                           distribute_tau,
                           prefactors,
                           u,
                           vxc,
+                          true,
                           ao_compressed_num,
                           ao_compressed_index,
                           ao_compressed,
                           ao_compressed_num,
                           ao_compressed_index,
-                          ao_compressed);
+                          ao_compressed,
+                          ao_compressed_single);
         delete[] ao_compressed;
+        delete[] ao_compressed_single;
         delete[] ao_compressed_index;
         delete[] ao_centers;
+        delete[] shell_off;
     }
     else
     {
         auto get_geo_offset = [&](int i, int j, int k) {
-            return balboa_get_geo_offset(balboa_context, i, j, k);
+            return balboa_get_geo_offset(ao_context, i, j, k);
         };
-        int num_aos = balboa_get_num_aos(balboa_context);
+        int num_aos = balboa_get_num_aos(ao_context);
         int max_ao_geo_order = 5; // FIXME hardcoded
         int buffer_len = balboa_get_buffer_len(
-            balboa_context, max_ao_geo_order, AO_BLOCK_LENGTH);
+            ao_context, max_ao_geo_order, AO_BLOCK_LENGTH);
         int *ao_centers = new int[num_aos];
         for (int i = 0; i < num_aos; i++)
         {
-            ao_centers[i] = balboa_get_ao_center(balboa_context, i);
+            ao_centers[i] = balboa_get_ao_center(ao_context, i);
         }
         get_mat_geo_derv(mat_dim,
+                         matrix_layout,
                          num_aos,
                          block_length,
                          buffer_len,
@@ -1405,13 +2696,6 @@ void XCint::distribute_matrix2(const int block_length,
         delete[] ao_centers;
     }
 
-    for (int ib = 0; ib < block_length; ib++)
-    {
-        exc += xcout[ib * dens_offset] * grid_w[w_off + ib];
-    }
-
-    delete[] xcin;
-    delete[] xcout;
 }
 
 void XCint::compute_slice_offsets(const std::vector<int> &coor, int off[])
@@ -1421,8 +2705,8 @@ void XCint::compute_slice_offsets(const std::vector<int> &coor, int off[])
     {
         kp[(coor[j] - 1) % 3]++;
     }
-    off[0] = balboa_get_geo_offset(balboa_context, kp[0], kp[1], kp[2]);
-    off[1] = balboa_get_geo_offset(balboa_context, kp[0] + 1, kp[1], kp[2]);
-    off[2] = balboa_get_geo_offset(balboa_context, kp[0], kp[1] + 1, kp[2]);
-    off[3] = balboa_get_geo_offset(balboa_context, kp[0], kp[1], kp[2] + 1);
+    off[0] = balboa_get_geo_offset(ao_context, kp[0], kp[1], kp[2]);
+    off[1] = balboa_get_geo_offset(ao_context, kp[0] + 1, kp[1], kp[2]);
+    off[2] = balboa_get_geo_offset(ao_context, kp[0], kp[1] + 1, kp[2]);
+    off[3] = balboa_get_geo_offset(ao_context, kp[0], kp[1], kp[2] + 1);
 }
@@ -2,9 +2,11 @@
 
 #include "Functional.h"
 #include "balboa.h"
+#include "matrix_layout.h"
 #include "xcint.h"
 
 #include <string>
+#include <vector>
 
 class XCint
 {
@@ -24,6 +26,14 @@ class XCint
 
     int set_functional(      char *line);
 
+    int set_precision(const xcint_precision_t precision);
+
+    int set_spherical_transform(const xcint_transform_t transform);
+
+    int set_matrix_storage(const xcint_storage_t storage,
+                           const int num_blocks,
+                           const int block_centers[]);
+
     int integrate(const xcint_mode_t mode,
                   const int num_points,
                   const double grid_x_bohr[],
@@ -41,17 +51,118 @@ class XCint
                   const bool get_vxc,
                   double vxc[],
                   double *num_electrons);
-    //   double *num_electrons) const;
+
+    int integrate_gradient(const xcint_mode_t mode,
+                           const int num_points,
+                           const double grid_x_bohr[],
+                           const double grid_y_bohr[],
+                           const double grid_z_bohr[],
+                           const double grid_w[],
+                           const double dmat[],
+                           double gradient[]);
+
+    int integrate_hessian(const xcint_mode_t mode,
+                          const int num_points,
+                          const double grid_x_bohr[],
+                          const double grid_y_bohr[],
+                          const double grid_z_bohr[],
+                          const double grid_w[],
+                          const int num_dmat,
+                          const double dmat[],
+                          double hessian[]);
 
   private:
     XCint(const XCint &rhs);            // not implemented
     XCint &operator=(const XCint &rhs); // not implemented
 
+    // integrate with matrices in the basis of ao_context
+    int integrate_points(const xcint_mode_t mode,
+                         const int num_points,
+                         const double grid_x_bohr[],
+                         const double grid_y_bohr[],
+                         const double grid_z_bohr[],
+                         const double grid_w[],
+                         const int num_perturbations,
+                         const xcint_perturbation_t perturbations[],
+                         const int components[],
+                         const int num_dmat,
+                         const int perturbation_indices[],
+                         const double dmat[],
+                         const bool get_exc,
+                         double *exc,
+                         const bool get_vxc,
+                         double vxc[],
+                         double *num_electrons);
+    //   double *num_electrons) const;
+
+    // integrate_gradient with dmat in the basis of ao_context
+    int integrate_gradient_points(const xcint_mode_t mode,
+                                  const int num_points,
+                                  const double grid_x_bohr[],
+                                  const double grid_y_bohr[],
+                                  const double grid_z_bohr[],
+                                  const double grid_w[],
+                                  const double dmat[],
+                                  double gradient[]);
+
+    // integrate_hessian with matrices in the basis of ao_context
+    int integrate_hessian_points(const xcint_mode_t mode,
+                                 const int num_points,
+                                 const double grid_x_bohr[],
+                                 const double grid_y_bohr[],
+                                 const double grid_z_bohr[],
+                                 const double grid_w[],
+                                 const int num_dmat,
+                                 const double dmat[],
+                                 double hessian[]);
+
+    // centers with AOs for a pass over geometric derivatives, all but
+    // the returned one which follows from translational invariance
+    int get_derv_centers(const int ao_centers[],
+                         bool center_is_used[],
+                         std::vector<int> &derv_centers) const;
+
     std::string functional_line;
     balboa_context_t *balboa_context;
+    // Cartesian twin of balboa_context for XCINT_TRANSFORM_DMAT
+    balboa_context_t *cartesian_context;
+    // evaluates the AOs, one of the two above
+    balboa_context_t *ao_context;
+    bool use_cartesian_dmat;
+    // per shell the (Cartesian x spherical) coefficients, row-major
+    std::vector<double> cs_transform;
+    std::vector<int> cs_transform_off;
+    bool use_mixed_precision;
+    int num_basis_centers;
+    MatrixLayout matrix_layout;
+    std::vector<matrix_symmetry_t> dmat_symmetry;
 
     void nullify();
 
+    // u = w df/dvar for the densities in n, adds w f to exc
+    void get_xc_potential(const int block_length,
+                          const int num_variables,
+                          const int num_perturbations,
+                                xcfun_t *xcfun,
+                                Functional *fun,
+                          const int w_off,
+                          const bool n_is_used[],
+                          const double n[],
+                          double u[],
+                          double &exc,
+                          const double grid_w[]);
+
+    // u = w df/dvar and f2 = w d2f/dvar dvar for the density in n
+    void get_xc_derivatives(const int block_length,
+                            const int num_variables,
+                                  xcfun_t *xcfun,
+                                  Functional *fun,
+                            const int w_off,
+                            const double n[],
+                            double u[],
+                            double f2[],
+                            const double grid_w[]);
+
     void distribute_matrix2(const int block_length,
                             const int num_variables,
                             const int num_perturbations,
@@ -70,34 +181,91 @@ class XCint
                             const double grid_w[]);
     //            const double grid_w[]) const;
 
-    void integrate_batch(const double dmat[],
-                         xcfun_t *xcfun,
-                         Functional *fun,
-                         const bool get_exc,
-                         double &exc,
-                         const bool get_vxc,
-                         double vxc[],
-                         double &num_electrons,
-                         const int geo_coor[],
-                         const bool use_dmat[],
-                         const int num_dmat,
-                         const int perturbation_indices[],
-                         const int ipoint,
-                         const int geo_derv_order,
-                         const int max_ao_order_g,
-                         const int block_length,
-                         const int num_variables,
-                         const int num_perturbations,
-                         const int num_fields,
-                         const int mat_dim,
-                         const bool get_gradient,
-                         const bool get_tau,
-                         const int dmat_index[],
-                         const double grid_x_bohr[],
-                         const double grid_y_bohr[],
-                         const double grid_z_bohr[],
-                         //     const double grid_w[]) const;
-                         const double grid_w[]);
+    int integrate_batch(balboa_workspace_t *workspace,
+                        const double dmat[],
+                        xcfun_t *xcfun,
+                        Functional *fun,
+                        const bool get_exc,
+                        double &exc,
+                        const bool get_vxc,
+                        double vxc[],
+                        double &num_electrons,
+                        const int geo_coor[],
+                        const bool use_dmat[],
+                        const int num_dmat,
+                        const int perturbation_indices[],
+                        const int ipoint,
+                        const int geo_derv_order,
+                        const int max_ao_order_g,
+                        const int block_length,
+                        const int num_variables,
+                        const int num_perturbations,
+                        const int num_fields,
+                        const int mat_dim,
+                        const bool get_gradient,
+                        const bool get_tau,
+                        const int dmat_index[],
+                        const double grid_x_bohr[],
+                        const double grid_y_bohr[],
+                        const double grid_z_bohr[],
+                        //     const double grid_w[]) const;
+                        const double grid_w[]);
+
+    // adds the gradient contributions of the AOs on the centers
+    // with center_is_used for the points of one batch
+    int integrate_gradient_batch(balboa_workspace_t *workspace,
+                                 const double dmat[],
+                                 const bool dmat_is_symmetric,
+                                       xcfun_t *xcfun,
+                                       Functional *fun,
+                                 const int ipoint,
+                                 const int block_length,
+                                 const int num_variables,
+                                 const int max_ao_order_g,
+                                 const bool get_gradient,
+                                 const bool get_tau,
+                                 const int ao_centers[],
+                                 const int num_shells,
+                                 const int shell_off[],
+                                 const int num_derv_centers,
+                                 const int derv_centers[],
+                                 const bool center_is_used[],
+                                 const double grid_x_bohr[],
+                                 const double grid_y_bohr[],
+                                 const double grid_z_bohr[],
+                                 const double grid_w[],
+                                 double gradient[]);
+
+    // adds the second derivative contributions of the AOs on the
+    // centers with center_is_used for the points of one batch
+    int integrate_hessian_batch(balboa_workspace_t *workspace,
+                                const double dmat[],
+                                const bool dmat_is_symmetric,
+                                const int num_rmat,
+                                const double rmat[],
+                                      xcfun_t *xcfun,
+                                      Functional *fun,
+                                const int ipoint,
+                                const int block_length,
+                                const int num_variables,
+                                const int max_ao_order_g,
+                                const bool get_gradient,
+                                const bool get_tau,
+                                const int ao_centers[],
+                                const int num_shells,
+                                const int shell_off[],
+                                const int num_derv_centers,
+                                const int derv_centers[],
+                                const bool center_is_used[],
+                                const double grid_x_bohr[],
+                                const double grid_y_bohr[],
+                                const double grid_z_bohr[],
+                                const double grid_w[],
+                                double hessian[],
+                                double response[]);
+
+    void transform_to_cartesian(const double mat[], double mat_cart[]) const;
+    void transform_to_spherical(const double mat_cart[], double mat[]) const;
 
     void compute_slice_offsets(const std::vector<int> &coor, int off[]);
 };
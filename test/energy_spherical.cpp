@@ -1,4 +1,6 @@
 #include <fstream>
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>  /* getenv */
 
 #include "gtest/gtest.h"
@@ -251,6 +253,24 @@ TEST(xcint, energy_spherical)
                            primitive_exponents,
                            contraction_coefficients);
 
+    // same basis with dmat transformed to the Cartesian basis instead
+    // of the AOs to the spherical one
+    xcint_context_t *xcint_context_cart = xcint_new_context();
+    ierr = xcint_set_spherical_transform(xcint_context_cart,
+                                         XCINT_TRANSFORM_DMAT);
+    ASSERT_EQ(ierr, 0);
+    ierr = xcint_set_basis(xcint_context_cart,
+                           XCINT_BASIS_SPHERICAL,
+                           num_centers,
+                           center_coordinates,
+                           num_shells,
+                           shell_centers,
+                           shell_l_quantum_numbers,
+                           shell_num_primitives,
+                           primitive_exponents,
+                           contraction_coefficients);
+    ASSERT_EQ(ierr, 0);
+
     delete[] center_coordinates;
     center_coordinates = NULL;
     delete[] proton_charges;
@@ -343,10 +363,551 @@ TEST(xcint, energy_spherical)
     }
     ASSERT_NEAR(dot, -5.610571165249672, 1.0e-12);
 
+    // all components in one pass have to match the components from
+    // one call each; the fluorine (most AOs) follows from the others by
+    // translational invariance and differs by the grid error, so only
+    // the hydrogen is compared
+    double gradient[6];
+    ierr = xcint_integrate_gradient(xcint_context,
+                                    XCINT_MODE_RKS,
+                                    num_points,
+                                    grid_x_bohr,
+                                    grid_y_bohr,
+                                    grid_z_bohr,
+                                    grid_w,
+                                    dmat,
+                                    gradient);
+    ASSERT_EQ(ierr, 0);
+
+    for (int c = 4; c <= 6; c++)
+    {
+        xcint_perturbation_t perturbations[1] = {XCINT_PERT_GEO};
+        int components[2] = {c, 0};
+        int perturbation_indices[1] = {0};
+        ierr = xcint_integrate(xcint_context,
+                               XCINT_MODE_RKS,
+                               num_points,
+                               grid_x_bohr,
+                               grid_y_bohr,
+                               grid_z_bohr,
+                               grid_w,
+                               1,
+                               perturbations,
+                               components,
+                               1,
+                               perturbation_indices,
+                               dmat,
+                               true,
+                               &exc,
+                               false,
+                               vxc,
+                               &num_electrons);
+        ASSERT_EQ(ierr, 0);
+        ASSERT_NEAR(gradient[c - 1], exc, 1.0e-12);
+    }
+
+    // the hydrogen block of the hessian has to match the second
+    // derivatives from one call each
+    double hessian[36];
+    ierr = xcint_integrate_hessian(xcint_context,
+                                   XCINT_MODE_RKS,
+                                   num_points,
+                                   grid_x_bohr,
+                                   grid_y_bohr,
+                                   grid_z_bohr,
+                                   grid_w,
+                                   1,
+                                   dmat,
+                                   hessian);
+    ASSERT_EQ(ierr, 0);
+
+    // only the energy is requested, the unfinished matrix contribution
+    // of second geometric derivatives (XCINT_IGNORE_STOPS) is not reached
+    for (int c = 4; c <= 6; c++)
+    {
+        for (int d = 4; d <= 6; d++)
+        {
+            xcint_perturbation_t perturbations[2] = {XCINT_PERT_GEO,
+                                                     XCINT_PERT_GEO};
+            int components[4] = {c, 0, d, 0};
+            int perturbation_indices[1] = {0};
+            ierr = xcint_integrate(xcint_context,
+                                   XCINT_MODE_RKS,
+                                   num_points,
+                                   grid_x_bohr,
+                                   grid_y_bohr,
+                                   grid_z_bohr,
+                                   grid_w,
+                                   2,
+                                   perturbations,
+                                   components,
+                                   1,
+                                   perturbation_indices,
+                                   dmat,
+                                   true,
+                                   &exc,
+                                   false,
+                                   vxc,
+                                   &num_electrons);
+            ASSERT_EQ(ierr, 0);
+            ASSERT_NEAR(hessian[(c - 1) * 6 + d - 1], exc, 1.0e-12);
+        }
+    }
+
+    // with one perturbed matrix per coordinate the added response has
+    // to match the change of the gradient along that matrix, also in
+    // the rows and columns of the fluorine, which are obtained from
+    // translational invariance
+    {
+        int num_dmat = 7;
+        double *dmat_all = new double[num_dmat*mat_dim*mat_dim];
+        std::copy(&dmat[0], &dmat[mat_dim*mat_dim], &dmat_all[0]);
+        for (int b = 0; b < 6; b++)
+        {
+            double *r = &dmat_all[(b + 1)*mat_dim*mat_dim];
+            for (int i = 0; i < mat_dim; i++)
+            {
+                for (int j = 0; j < mat_dim; j++)
+                {
+                    r[i*mat_dim + j] = 0.01*cos(b + i + j + 0.5*i*j);
+                }
+            }
+        }
+
+        double hessian_response[36];
+        ierr = xcint_integrate_hessian(xcint_context,
+                                       XCINT_MODE_RKS,
+                                       num_points,
+                                       grid_x_bohr,
+                                       grid_y_bohr,
+                                       grid_z_bohr,
+                                       grid_w,
+                                       num_dmat,
+                                       dmat_all,
+                                       hessian_response);
+        ASSERT_EQ(ierr, 0);
+
+        double step = 1.0e-4;
+        double gradient_step[2][6];
+        double *dmat_step = new double[mat_dim*mat_dim];
+        for (int b = 0; b < 6; b++)
+        {
+            const double *r = &dmat_all[(b + 1)*mat_dim*mat_dim];
+            for (int k = 0; k < 2; k++)
+            {
+                double f = (k == 0) ? step : -step;
+                for (int i = 0; i < mat_dim*mat_dim; i++)
+                {
+                    dmat_step[i] = dmat[i] + f*r[i];
+                }
+                ierr = xcint_integrate_gradient(xcint_context,
+                                                XCINT_MODE_RKS,
+                                                num_points,
+                                                grid_x_bohr,
+                                                grid_y_bohr,
+                                                grid_z_bohr,
+                                                grid_w,
+                                                dmat_step,
+                                                gradient_step[k]);
+                ASSERT_EQ(ierr, 0);
+            }
+            for (int a = 0; a < 6; a++)
+            {
+                double fd = (gradient_step[0][a] - gradient_step[1][a])
+                            /(2.0*step);
+                ASSERT_NEAR(hessian_response[a*6 + b] - hessian[a*6 + b],
+                            fd,
+                            1.0e-6);
+            }
+        }
+
+        delete[] dmat_step;
+        dmat_step = NULL;
+        delete[] dmat_all;
+        dmat_all = NULL;
+    }
+
+    // linear response: an antisymmetric perturbed matrix gives no
+    // density, so a general matrix has to give the same result as its
+    // symmetric part
+    {
+        xcint_perturbation_t perturbations[1] = {XCINT_PERT_EL};
+        int components[2] = {0, 0};
+        int perturbation_indices[2] = {0, 1};
+
+        double *dmat_pert = new double[2*mat_dim*mat_dim];
+        double *vxc_sym = new double[mat_dim*mat_dim];
+        std::copy(&dmat[0], &dmat[mat_dim*mat_dim], &dmat_pert[0]);
+
+        // k = 0: symmetric part, 1: antisymmetric part, 2: both
+        for (int k = 0; k < 3; k++)
+        {
+            for (int i = 0; i < mat_dim; i++)
+            {
+                for (int j = 0; j < mat_dim; j++)
+                {
+                    double s = 0.1*cos(i + 2.0*j) + 0.1*cos(j + 2.0*i);
+                    double a = 0.1*sin(i - 3.0*j) - 0.1*sin(j - 3.0*i);
+                    double d = (k == 0) ? s : ((k == 1) ? a : s + a);
+                    dmat_pert[mat_dim*mat_dim + i*mat_dim + j] = d;
+                }
+            }
+            ierr = xcint_integrate(xcint_context,
+                                   XCINT_MODE_RKS,
+                                   num_points,
+                                   grid_x_bohr,
+                                   grid_y_bohr,
+                                   grid_z_bohr,
+                                   grid_w,
+                                   1,
+                                   perturbations,
+                                   components,
+                                   2,
+                                   perturbation_indices,
+                                   dmat_pert,
+                                   false,
+                                   &exc,
+                                   true,
+                                   vxc,
+                                   &num_electrons);
+            ASSERT_EQ(ierr, 0);
+
+            for (int i = 0; i < mat_dim*mat_dim; i++)
+            {
+                if (k == 0)
+                    vxc_sym[i] = vxc[i];
+                if (k == 1)
+                    ASSERT_NEAR(vxc[i], 0.0, 1.0e-12);
+                if (k == 2)
+                    ASSERT_NEAR(vxc[i], vxc_sym[i], 1.0e-12);
+            }
+        }
+
+        delete[] dmat_pert;
+        dmat_pert = NULL;
+        delete[] vxc_sym;
+        vxc_sym = NULL;
+    }
+
+    // mixed precision has to reproduce the reference within
+    // the single-precision error bounds
+    ierr = xcint_set_precision(xcint_context, XCINT_PRECISION_MIXED);
+    ASSERT_EQ(ierr, 0);
+
+    ierr = xcint_integrate_scf(xcint_context,
+                               XCINT_MODE_RKS,
+                               num_points,
+                               grid_x_bohr,
+                               grid_y_bohr,
+                               grid_z_bohr,
+                               grid_w,
+                               dmat,
+                               &exc,
+                               vxc,
+                               &num_electrons);
+
+    ASSERT_NEAR(num_electrons, 9.999992072209077, 1.0e-5);
+    ASSERT_NEAR(exc, -17.475254754225027, 1.0e-5);
+
+    dot = 0.0;
+    for (int i = 0; i < mat_dim*mat_dim; i++)
+    {
+        dot += vxc[i]*dmat[i];
+    }
+    ASSERT_NEAR(dot, -5.610571165249672, 1.0e-5);
+
+    ierr = xcint_set_precision(xcint_context, XCINT_PRECISION_DOUBLE);
+    ASSERT_EQ(ierr, 0);
+
+    // meta-GGA derivative of the XC matrix with respect to a hydrogen
+    // coordinate, where the differentiated AOs differ from all others;
+    // contracted with dmat it is half the change of the energy
+    // derivative along dmat
+    ierr = xcint_set_functional(xcint_context, "m06");
+    ASSERT_EQ(ierr, 0);
+
+    {
+        xcint_perturbation_t perturbations[1] = {XCINT_PERT_GEO};
+        int components[2] = {4, 0};
+        int perturbation_indices[1] = {0};
+        ierr = xcint_integrate(xcint_context,
+                               XCINT_MODE_RKS,
+                               num_points,
+                               grid_x_bohr,
+                               grid_y_bohr,
+                               grid_z_bohr,
+                               grid_w,
+                               1,
+                               perturbations,
+                               components,
+                               1,
+                               perturbation_indices,
+                               dmat,
+                               false,
+                               &exc,
+                               true,
+                               vxc,
+                               &num_electrons);
+        ASSERT_EQ(ierr, 0);
+
+        dot = 0.0;
+        for (int i = 0; i < mat_dim*mat_dim; i++)
+        {
+            dot += vxc[i]*dmat[i];
+        }
+
+        double step = 1.0e-4;
+        double exc_step[2];
+        double *dmat_step = new double[mat_dim*mat_dim];
+        for (int k = 0; k < 2; k++)
+        {
+            double f = (k == 0) ? 1.0 + step : 1.0 - step;
+            for (int i = 0; i < mat_dim*mat_dim; i++)
+            {
+                dmat_step[i] = f*dmat[i];
+            }
+            ierr = xcint_integrate(xcint_context,
+                                   XCINT_MODE_RKS,
+                                   num_points,
+                                   grid_x_bohr,
+                                   grid_y_bohr,
+                                   grid_z_bohr,
+                                   grid_w,
+                                   1,
+                                   perturbations,
+                                   components,
+                                   1,
+                                   perturbation_indices,
+                                   dmat_step,
+                                   true,
+                                   &exc_step[k],
+                                   false,
+                                   vxc,
+                                   &num_electrons);
+            ASSERT_EQ(ierr, 0);
+        }
+        delete[] dmat_step;
+        dmat_step = NULL;
+
+        ASSERT_NEAR(2.0*dot, (exc_step[0] - exc_step[1])/(2.0*step), 1.0e-6);
+    }
+
+    // block-sparse storage without the F-H blocks has to match dense
+    // storage with these blocks zeroed
+    {
+        int num_aos_f = 14;
+        int block_centers[4] = {1, 1, 2, 2};
+
+        double *dmat_dense = new double[mat_dim*mat_dim];
+        double *dmat_blocks = new double[mat_dim*mat_dim];
+        double *vxc_blocks = new double[mat_dim*mat_dim];
+
+        for (int k = 0; k < mat_dim; k++)
+        {
+            for (int l = 0; l < mat_dim; l++)
+            {
+                bool same_center = ((k < num_aos_f) == (l < num_aos_f));
+                dmat_dense[k*mat_dim + l] = 0.0;
+                if (same_center)
+                    dmat_dense[k*mat_dim + l] = dmat[k*mat_dim + l];
+            }
+        }
+
+        // blocks one after the other, each row-major
+        int n = 0;
+        for (int b = 0; b < 2; b++)
+        {
+            int first = (b == 0) ? 0 : num_aos_f;
+            int last = (b == 0) ? num_aos_f : mat_dim;
+            for (int k = first; k < last; k++)
+            {
+                for (int l = first; l < last; l++)
+                {
+                    dmat_blocks[n++] = dmat[k*mat_dim + l];
+                }
+            }
+        }
+
+        double exc_dense = 0.0;
+        double num_electrons_dense = 0.0;
+        ierr = xcint_integrate_scf(xcint_context,
+                                   XCINT_MODE_RKS,
+                                   num_points,
+                                   grid_x_bohr,
+                                   grid_y_bohr,
+                                   grid_z_bohr,
+                                   grid_w,
+                                   dmat_dense,
+                                   &exc_dense,
+                                   vxc,
+                                   &num_electrons_dense);
+        ASSERT_EQ(ierr, 0);
+
+        ierr = xcint_set_matrix_storage(xcint_context,
+                                        XCINT_STORAGE_BLOCK_SPARSE,
+                                        2,
+                                        block_centers);
+        ASSERT_EQ(ierr, 0);
+
+        ierr = xcint_integrate_scf(xcint_context,
+                                   XCINT_MODE_RKS,
+                                   num_points,
+                                   grid_x_bohr,
+                                   grid_y_bohr,
+                                   grid_z_bohr,
+                                   grid_w,
+                                   dmat_blocks,
+                                   &exc,
+                                   vxc_blocks,
+                                   &num_electrons);
+        ASSERT_EQ(ierr, 0);
+
+        ASSERT_NEAR(num_electrons, num_electrons_dense, 1.0e-12);
+        ASSERT_NEAR(exc, exc_dense, 1.0e-12);
+
+        n = 0;
+        for (int b = 0; b < 2; b++)
+        {
+            int first = (b == 0) ? 0 : num_aos_f;
+            int last = (b == 0) ? num_aos_f : mat_dim;
+            for (int k = first; k < last; k++)
+            {
+                for (int l = first; l < last; l++)
+                {
+                    ASSERT_NEAR(vxc_blocks[n++], vxc[k*mat_dim + l], 1.0e-12);
+                }
+            }
+        }
+
+        // the pattern has to be symmetric and list every block once
+        int nonsymmetric_centers[6] = {1, 1, 2, 2, 1, 2};
+        ierr = xcint_set_matrix_storage(xcint_context,
+                                        XCINT_STORAGE_BLOCK_SPARSE,
+                                        3,
+                                        nonsymmetric_centers);
+        ASSERT_EQ(ierr, -1);
+
+        int duplicate_centers[6] = {1, 1, 2, 2, 1, 1};
+        ierr = xcint_set_matrix_storage(xcint_context,
+                                        XCINT_STORAGE_BLOCK_SPARSE,
+                                        3,
+                                        duplicate_centers);
+        ASSERT_EQ(ierr, -1);
+
+        ierr = xcint_set_matrix_storage(xcint_context,
+                                        XCINT_STORAGE_DENSE,
+                                        0,
+                                        NULL);
+        ASSERT_EQ(ierr, 0);
+
+        delete[] dmat_dense;
+        dmat_dense = NULL;
+        delete[] dmat_blocks;
+        dmat_blocks = NULL;
+        delete[] vxc_blocks;
+        vxc_blocks = NULL;
+    }
+
+    // transforming dmat and vxc instead of the AOs has to give the same
+    // numbers, for the SCF contribution and for a geometric derivative
+    {
+        double *vxc_cart = new double[mat_dim*mat_dim];
+        double exc_cart = 0.0;
+        double num_electrons_cart = 0.0;
+
+        ierr = xcint_set_functional(xcint_context, "b3lyp");
+        ASSERT_EQ(ierr, 0);
+        ierr = xcint_set_functional(xcint_context_cart, "b3lyp");
+        ASSERT_EQ(ierr, 0);
+
+        ierr = xcint_integrate_scf(xcint_context,
+                                   XCINT_MODE_RKS,
+                                   num_points,
+                                   grid_x_bohr,
+                                   grid_y_bohr,
+                                   grid_z_bohr,
+                                   grid_w,
+                                   dmat,
+                                   &exc,
+                                   vxc,
+                                   &num_electrons);
+        ASSERT_EQ(ierr, 0);
+        ierr = xcint_integrate_scf(xcint_context_cart,
+                                   XCINT_MODE_RKS,
+                                   num_points,
+                                   grid_x_bohr,
+                                   grid_y_bohr,
+                                   grid_z_bohr,
+                                   grid_w,
+                                   dmat,
+                                   &exc_cart,
+                                   vxc_cart,
+                                   &num_electrons_cart);
+        ASSERT_EQ(ierr, 0);
+
+        ASSERT_NEAR(num_electrons_cart, num_electrons, 1.0e-12);
+        ASSERT_NEAR(exc_cart, exc, 1.0e-12);
+        for (int i = 0; i < mat_dim*mat_dim; i++)
+        {
+            ASSERT_NEAR(vxc_cart[i], vxc[i], 1.0e-12);
+        }
+
+        xcint_perturbation_t perturbations[1] = {XCINT_PERT_GEO};
+        int components[2] = {4, 0};
+        int perturbation_indices[1] = {0};
+        ierr = xcint_integrate(xcint_context,
+                               XCINT_MODE_RKS,
+                               num_points,
+                               grid_x_bohr,
+                               grid_y_bohr,
+                               grid_z_bohr,
+                               grid_w,
+                               1,
+                               perturbations,
+                               components,
+                               1,
+                               perturbation_indices,
+                               dmat,
+                               false,
+                               &exc,
+                               true,
+                               vxc,
+                               &num_electrons);
+        ASSERT_EQ(ierr, 0);
+        ierr = xcint_integrate(xcint_context_cart,
+                               XCINT_MODE_RKS,
+                               num_points,
+                               grid_x_bohr,
+                               grid_y_bohr,
+                               grid_z_bohr,
+                               grid_w,
+                               1,
+                               perturbations,
+                               components,
+                               1,
+                               perturbation_indices,
+                               dmat,
+                               false,
+                               &exc_cart,
+                               true,
+                               vxc_cart,
+                               &num_electrons_cart);
+        ASSERT_EQ(ierr, 0);
+
+        for (int i = 0; i < mat_dim*mat_dim; i++)
+        {
+            ASSERT_NEAR(vxc_cart[i], vxc[i], 1.0e-12);
+        }
+
+        delete[] vxc_cart;
+        vxc_cart = NULL;
+    }
+
     delete[] dmat;
     dmat = NULL;
     delete[] vxc;
     vxc = NULL;
 
     xcint_free_context(xcint_context);
+    xcint_free_context(xcint_context_cart);
 }
@@ -6,8 +6,10 @@ program test
                     xcint_set_functional, &
                     xcint_integrate_scf,  &
                     xcint_integrate,      &
+                    xcint_set_matrix_storage, &
                     XCINT_MODE_RKS,       &
-                    XCINT_BASIS_SPHERICAL
+                    XCINT_BASIS_SPHERICAL, &
+                    XCINT_STORAGE_PACKED
 
    use numgrid
 
@@ -34,13 +36,15 @@ program test
    integer              :: num_points_center
    integer, parameter   :: io_unit = 13
    real(8)              :: ref(4)
-   integer              :: i, j, k
+   integer              :: i, j, k, l
    integer              :: center_index
    integer              :: ipoint
    real(8)              :: error
    integer              :: ierr
    real(8), allocatable :: dmat(:)
    real(8), allocatable :: vxc(:)
+   real(8), allocatable :: dmat_packed(:)
+   real(8), allocatable :: vxc_packed(:)
    integer              :: mat_dim
    real(8)              :: exc
    real(8)              :: num_electrons
@@ -337,14 +341,51 @@ program test
                           vxc,            &
                           num_electrons)
 
+   if (dabs(num_electrons - 9.999992072209077d0) > 1.0e-12) stop 1
+   if (dabs(exc + 17.475254754225027d0) > 1.0e-12) stop 1
+
+   ! same in packed storage, seen from here the upper triangle by columns
+   allocate(dmat_packed(mat_dim*(mat_dim+1)/2))
+   allocate(vxc_packed(mat_dim*(mat_dim+1)/2))
+   do k = 0, mat_dim - 1
+      do l = 0, k
+         dmat_packed(k*(k+1)/2 + l + 1) = dmat(k*mat_dim + l + 1)
+      end do
+   end do
+
+   ierr = xcint_set_matrix_storage(xcint_context,        &
+                                   XCINT_STORAGE_PACKED, &
+                                   0,                    &
+                                   (/0/))
+
+   ierr = xcint_integrate_scf(xcint_context,  &
+                              XCINT_MODE_RKS, &
+                              num_points,     &
+                              grid_x_bohr,    &
+                              grid_y_bohr,    &
+                              grid_z_bohr,    &
+                              grid_w,         &
+                              dmat_packed,    &
+                              exc,            &
+                              vxc_packed,     &
+                              num_electrons)
+
+   if (dabs(num_electrons - 9.999992072209077d0) > 1.0e-12) stop 1
+   if (dabs(exc + 17.475254754225027d0) > 1.0e-12) stop 1
+   do k = 0, mat_dim - 1
+      do l = 0, k
+         if (dabs(vxc_packed(k*(k+1)/2 + l + 1) - vxc(k*mat_dim + l + 1)) > 1.0e-12) stop 1
+      end do
+   end do
+
+   deallocate(dmat_packed)
+   deallocate(vxc_packed)
+
    deallocate(grid_x_bohr)
    deallocate(grid_y_bohr)
    deallocate(grid_z_bohr)
    deallocate(grid_w)
 
-   if (dabs(num_electrons - 9.999992072209077d0) > 1.0e-12) stop 1
-   if (dabs(exc + 17.475254754225027d0) > 1.0e-12) stop 1
-
    deallocate(dmat)
    deallocate(vxc)
 